@@ -0,0 +1,119 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures how long the FailoverQueue constructor takes to discover a
+** directory holding many failover files, and how long the first popw() then
+** takes to read one back. The files are fabricated by copying one real
+** failover file into a scratch directory under the given path.
+**
+** The constructor lists the directory, stats every file for its size and
+** modification time, and sorts the files by id. The stat pass is also timed
+** on its own to show its share of the time to ready.
+**
+** Usage: bench_bootstrap [directory] [file counts, comma separated]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+typedef FailoverQueue<int, int> IntQueue;
+
+//! Returns the content of one failover file holding a few items.
+std::string sampleFile(const std::string &path) {
+	std::string content;
+	{
+		IntQueue queue(path, 4);
+		for (int i = 0; i < 6; i++) {
+			queue.push(i);
+		}
+		std::vector<std::string> files = queue.failOverFiles();
+		std::ifstream ifs(files[0].c_str(), std::ios::in | std::ios::binary);
+		std::stringstream buffer;
+		buffer << ifs.rdbuf();
+		content = buffer.str();
+		queue.clear();
+		boost::filesystem::remove(files[0]);
+	}
+	return content;
+}
+
+void run(const std::string &path, const std::string &content, int files) {
+	boost::filesystem::remove_all(path);
+	boost::filesystem::create_directories(path);
+	for (int i = 1; i <= files; i++) {
+		std::stringstream name;
+		name << path << FQ_FILENAME << i << FQ_EXT;
+		std::ofstream ofs(name.str().c_str(), std::ios::out | std::ios::binary);
+		ofs << content;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 1; i <= files; i++) {
+		std::stringstream name;
+		name << path << FQ_FILENAME << i << FQ_EXT;
+		std::size_t bytes = 0;
+		unsigned long long modified = 0;
+		fq_file_status(name.str(), bytes, modified);
+	}
+	std::chrono::duration<double> stat = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	IntQueue queue(path, 100);
+	std::chrono::duration<double> ready = std::chrono::steady_clock::now() - start;
+	queue.popw();
+	std::chrono::duration<double> first = std::chrono::steady_clock::now() - start;
+
+	printf("files=%-8d ready=%.3fs first pop=%.3fs (%.2f us/file) stat=%.3fs (%.2f us/file)\n",
+		files, ready.count(), first.count(), ready.count() * 1e6 / files, stat.count(), stat.count() * 1e6 / files);
+	boost::filesystem::remove_all(path);
+}
+
+int main(int argc, char **argv) {
+	std::string base = argc > 1 ? argv[1] : "./";
+	const char *counts = argc > 2 ? argv[2] : "1000,10000,100000";
+
+	if (base.empty() || base[base.size() - 1] != '/') {
+		base += "/";
+	}
+	std::string path = base + "bootstrap-bench/";
+	boost::filesystem::remove_all(path);
+	boost::filesystem::create_directories(path);
+	std::string content = sampleFile(path);
+
+	for (const char *p = counts; p; p = strchr(p, ',') ? strchr(p, ',') + 1 : 0) {
+		int files = atoi(p);
+		if (files > 0) {
+			run(path, content, files);
+		}
+	}
+	boost::filesystem::remove_all(path);
+
+	return 0;
+}
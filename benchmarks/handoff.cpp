@@ -0,0 +1,98 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures the time between push() and the return of a popw() that was
+** already waiting for it, for blocking, spinning and adaptive consumers. The
+** producer waits until the consumer has taken the previous item and then
+** sleeps for a fixed gap, so every push finds the consumer waiting. Spinning
+** is disabled on single processor machines, where all three match.
+**
+** Usage: bench_handoff [items]
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define BENCH_PATH "./"
+
+typedef FailoverQueue<long long, long long> TimeQueue;
+
+long long now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void consume(TimeQueue *queue, int items, std::vector<long long> *latencies, std::atomic<int> *popped) {
+	for (int i = 0; i < items; i++) {
+		long long sent = queue->popw();
+		(*latencies)[i] = now() - sent;
+		popped->store(i + 1, std::memory_order_release);
+	}
+}
+
+void run(const char *name, fq_wait_strategy strategy, int items, int gap) {
+	TimeQueue queue(BENCH_PATH, 100000000);
+	queue.waitStrategy(strategy);
+
+	std::vector<long long> latencies(items);
+	std::atomic<int> popped(0);
+	boost::thread consumer(boost::bind(&consume, &queue, items, &latencies, &popped));
+	for (int i = 0; i < items; i++) {
+		while (popped.load(std::memory_order_acquire) < i) {
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(gap));
+		queue.push(now());
+	}
+	consumer.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	long long total = 0;
+	for (int i = 0; i < items; i++) {
+		total += latencies[i];
+	}
+	printf("%-9s gap=%4dus items=%d mean=%lldns p50=%lldns p99=%lldns max=%lldns\n",
+		name, gap, items, total / items, latencies[items / 2], latencies[items * 99 / 100], latencies[items - 1]);
+}
+
+int main(int argc, char **argv) {
+	int items = argc > 1 ? atoi(argv[1]) : 2000;
+	int gaps[] = { 2, 20, 200 };
+	printf("cpus=%u\n", boost::thread::hardware_concurrency());
+
+	for (int g = 0; g < 3; g++) {
+		run("block", fq_wait_block, items, gaps[g]);
+		run("spin", fq_wait_spin, items, gaps[g]);
+		run("adaptive", fq_wait_adaptive, items, gaps[g]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures throughput and hardware cache misses with producers and spinning
+** consumers sharing one queue. bench_layout uses the default member layout
+** and bench_layout_packed is built with FQ_FIELD_ALIGN defined empty, so the
+** difference between the two shows what the cache line grouping saves.
+**
+** Cache misses are counted with perf_event_open() and are reported as
+** unavailable where the kernel does not allow it, for example when
+** perf_event_paranoid is too high or inside most containers.
+**
+** Usage: bench_layout [producers] [consumers] [items per producer]
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define BENCH_PATH "./"
+#define BENCH_STRING(X) #X
+#define BENCH_EXPAND(X) BENCH_STRING(X)
+
+typedef FailoverQueue<int, int> IntQueue;
+
+//! Opens a cache miss counter covering this thread and the threads it creates afterwards.
+int openCounter() {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void produce(IntQueue *queue, int items) {
+	for (int i = 0; i < items; i++) {
+		queue->push(i);
+	}
+}
+
+void consume(IntQueue *queue, int items) {
+	for (int i = 0; i < items; i++) {
+		queue->popw();
+	}
+}
+
+int main(int argc, char **argv) {
+	int producers = argc > 1 ? atoi(argv[1]) : 2;
+	int consumers = argc > 2 ? atoi(argv[2]) : 2;
+	int items = argc > 3 ? atoi(argv[3]) : 500000;
+
+	IntQueue queue(BENCH_PATH, 100000000);
+	queue.waitStrategy(fq_wait_adaptive);
+
+	int counter = openCounter();
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	boost::thread_group threads;
+	for (int c = 0; c < consumers; c++) {
+		threads.create_thread(boost::bind(&consume, &queue, producers * items / consumers));
+	}
+	for (int p = 0; p < producers; p++) {
+		threads.create_thread(boost::bind(&produce, &queue, items));
+	}
+	threads.join_all();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	long long misses = -1;
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+			misses = -1;
+		}
+		close(counter);
+	}
+
+	printf("%-7s sizeof=%d producers=%d consumers=%d items=%d elapsed=%.3fs throughput=%.0f items/s ",
+		strlen(BENCH_EXPAND(FQ_FIELD_ALIGN)) > 0 ? "grouped" : "packed", (int) sizeof(IntQueue), producers, consumers, producers * items,
+		elapsed.count(), producers * items / elapsed.count());
+	if (misses >= 0) {
+		printf("cache-misses=%lld (%.2f per item)\n", misses, (double) misses / (producers * items));
+	} else {
+		printf("cache-misses=unavailable\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Drives a queue through a script of load phases and samples it over time,
+** to reproduce overload followed by recovery. Each phase runs for a number of
+** seconds with a total produce rate and a total consume rate in items per
+** second; a consume rate of 0 is a consumer outage. The default script is
+**
+**   steady:10:5000:6000 burst:5:40000:6000 outage:10:5000:0 recovery:20:5000:20000
+**
+** Every sample interval one CSV row is written with the queue depth in
+** memory, the backlog and bytes in failover files, the push, pop, spill and
+** reload rates over the interval, the push to pop latency percentiles of the
+** items popped in it and the age of the oldest item in each tier.
+**
+** Usage: bench_load [--phase name:seconds:produce:consume]... [--producers N] [--consumers N]
+**                   [--max-size N] [--payload bytes] [--interval ms] [--directory path] [--output file.csv]
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/serialization/string.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class Payload {
+public:
+	Payload() : sent_(0) { }
+	explicit Payload(std::size_t bytes) : sent_(fq_now_nanos()), data_(bytes, 'x') { }
+	unsigned long long sent() const { return sent_; }
+private:
+	friend class boost::serialization::access;
+
+	unsigned long long sent_;
+	std::string data_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & sent_;
+		ar & data_;
+	}
+};
+
+typedef boost::shared_ptr<Payload> PayloadPtr;
+typedef FailoverQueue<Payload, PayloadPtr> PayloadQueue;
+
+struct Phase {
+	std::string name;
+	double seconds;
+	double produce;
+	double consume;
+};
+
+struct Shared {
+	PayloadQueue *queue;
+	std::vector<Phase> phases;
+	std::atomic<int> phase;
+	std::atomic<bool> done;
+	int producers;
+	int consumers;
+	int payload;
+	fq_histogram latency;
+};
+
+void reset(const std::string &path) {
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(path); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find(FQ_FILENAME) == 0) {
+				boost::filesystem::remove(dir_itr->path());
+			}
+		}
+	}
+}
+
+bool parsePhase(const char *text, Phase &phase) {
+	char name[64];
+	if (sscanf(text, "%63[^:]:%lf:%lf:%lf", name, &phase.seconds, &phase.produce, &phase.consume) != 4) {
+		return false;
+	}
+	phase.name = name;
+	return true;
+}
+
+//! Runs one producer or consumer at its share of the rate of the current phase, working in small batches.
+void pace(Shared *shared, bool producer) {
+	int threads = producer ? shared->producers : shared->consumers;
+	int current = -1;
+	double owed = 0;
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+	while (!shared->done.load()) {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		int index = shared->phase.load();
+		if (index != current) {
+			// A new phase starts with a clean slate rather than working off the last one's debt.
+			current = index;
+			owed = 0;
+		}
+		const Phase &phase = shared->phases[index];
+		owed += (producer ? phase.produce : phase.consume) / threads * std::chrono::duration<double>(now - last).count();
+		last = now;
+		for (; owed >= 1; owed -= 1) {
+			if (producer) {
+				shared->queue->push(PayloadPtr(new Payload(shared->payload)));
+			} else {
+				PayloadPtr item;
+				if (!shared->queue->try_pop(item)) {
+					// Nothing to pop; consumers do not bank the time they were idle.
+					owed = 0;
+					break;
+				}
+				shared->latency.record(fq_now_nanos() - item->sent());
+			}
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+}
+
+int main(int argc, char **argv) {
+	Shared shared;
+	shared.producers = 2;
+	shared.consumers = 2;
+	shared.payload = 256;
+	int maxSize = 10000;
+	int interval = 500;
+	std::string path = "./";
+	const char *output = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--phase") == 0) {
+			Phase phase;
+			if (!parsePhase(argv[i + 1], phase) || phase.seconds <= 0) {
+				fprintf(stderr, "Bad phase, expected name:seconds:produce:consume: %s\n", argv[i + 1]);
+				return 1;
+			}
+			shared.phases.push_back(phase);
+		} else if (strcmp(argv[i], "--producers") == 0) {
+			shared.producers = std::max(1, atoi(argv[i + 1]));
+		} else if (strcmp(argv[i], "--consumers") == 0) {
+			shared.consumers = std::max(1, atoi(argv[i + 1]));
+		} else if (strcmp(argv[i], "--max-size") == 0) {
+			maxSize = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "--payload") == 0) {
+			shared.payload = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "--interval") == 0) {
+			interval = std::max(10, atoi(argv[i + 1]));
+		} else if (strcmp(argv[i], "--directory") == 0) {
+			path = argv[i + 1];
+		} else if (strcmp(argv[i], "--output") == 0) {
+			output = argv[i + 1];
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (shared.phases.empty()) {
+		const char *script[] = { "steady:10:5000:6000", "burst:5:40000:6000", "outage:10:5000:0", "recovery:20:5000:20000" };
+		for (int i = 0; i < 4; i++) {
+			Phase phase;
+			parsePhase(script[i], phase);
+			shared.phases.push_back(phase);
+		}
+	}
+	if (path.empty() || path[path.size() - 1] != '/') {
+		path += "/";
+	}
+
+	FILE *out = output ? fopen(output, "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Cannot write: %s\n", output);
+		return 1;
+	}
+
+	reset(path);
+	PayloadQueue queue(path, maxSize);
+	shared.queue = &queue;
+	shared.phase.store(0);
+	shared.done.store(false);
+
+	boost::thread_group threads;
+	for (int p = 0; p < shared.producers; p++) {
+		threads.create_thread(boost::bind(&pace, &shared, true));
+	}
+	for (int c = 0; c < shared.consumers; c++) {
+		threads.create_thread(boost::bind(&pace, &shared, false));
+	}
+
+	fprintf(out, "seconds,phase,depth,backlog,disk_bytes,push_rate,pop_rate,spill_rate,reload_rate,latency_p50_ms,latency_p99_ms,latency_max_ms,memory_age_ms,disk_age_ms\n");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point sampled = start;
+	fq_stats previous = queue.stats();
+	double phaseEnd = shared.phases[0].seconds;
+	for (;;) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(interval));
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - start).count();
+		double span = std::chrono::duration<double>(now - sampled).count();
+		sampled = now;
+
+		fq_stats stats = queue.stats();
+		fq_histogram_snapshot latency = shared.latency.snapshot(true);
+		fq_ages ages = queue.ages();
+		int index = shared.phase.load();
+		fprintf(out, "%.3f,%s,%d,%ld,%lu,%.0f,%.0f,%.2f,%.2f,%.3f,%.3f,%.3f,%.1f,%.1f\n",
+			elapsed, shared.phases[index].name.c_str(), queue.size(), queue.backlog(), (unsigned long) queue.diskBytes(),
+			(stats.pushed - previous.pushed) / span, (stats.popped - previous.popped) / span,
+			(stats.spills - previous.spills) / span, (stats.reloads - previous.reloads) / span,
+			latency.percentile(50) / 1e6, latency.percentile(99) / 1e6, latency.max() / 1e6,
+			ages.memory / 1e6, ages.disk / 1e6);
+		fflush(out);
+		previous = stats;
+
+		if (elapsed >= phaseEnd) {
+			if (index + 1 == (int) shared.phases.size()) {
+				break;
+			}
+			shared.phase.store(index + 1);
+			phaseEnd += shared.phases[index + 1].seconds;
+		}
+	}
+
+	shared.done.store(true);
+	threads.join_all();
+	if (out != stdout) {
+		fclose(out);
+	}
+	reset(path);
+
+	return 0;
+}
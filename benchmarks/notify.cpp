@@ -0,0 +1,151 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Compares the cost of waking consumers in push(). The reference queues use
+** the same mutex, condition variable and deque protocol; one notifies on every
+** push, the other only when a consumer is blocked, as FailoverQueue does. The
+** notify count is the number of condition variable signals issued; for
+** FailoverQueue it is counted by the queue itself, which this benchmark is
+** built with FQ_COUNT_NOTIFIES for. Context switches are read from
+** getrusage(). To see the futex system calls themselves, run the benchmark
+** under strace -f -c -e trace=futex.
+**
+** Usage: bench_notify [items]
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+
+#define BENCH_PATH "./"
+
+template <bool WaiterAware>
+class ReferenceQueue {
+public:
+	ReferenceQueue() : waiters_(0), notifies_(0) { }
+
+	void push(int item) {
+		boost::mutex::scoped_lock lock(mutex_);
+		queue_.push_back(item);
+		if (!WaiterAware || waiters_ > 0) {
+			++notifies_;
+			condition_.notify_one();
+		}
+	}
+
+	int popw() {
+		boost::mutex::scoped_lock lock(mutex_);
+		while (queue_.empty()) {
+			++waiters_;
+			condition_.wait(lock);
+			--waiters_;
+		}
+		int item = queue_.front();
+		queue_.pop_front();
+		return item;
+	}
+
+	long notifies() const { return notifies_; }
+
+private:
+	boost::mutex mutex_;
+	boost::condition_variable condition_;
+	std::deque<int> queue_;
+	int waiters_;
+	long notifies_;
+};
+
+struct FailoverQueueInt : public FailoverQueue<int, int> {
+	FailoverQueueInt() : FailoverQueue<int, int>(BENCH_PATH, 100000000) { }
+};
+
+//! Pops items, spending work iterations on each one to simulate a consumer that falls behind.
+template <class Queue>
+void consume(Queue *queue, int items, int work) {
+	volatile int sink = 0;
+	for (int i = 0; i < items; i++) {
+		sink += queue->popw();
+		for (int w = 0; w < work; w++) {
+			sink += w;
+		}
+	}
+}
+
+long contextSwitches() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+//! Pushes items in bursts of burst items, pausing between bursts so that the consumer blocks.
+template <class Queue>
+void run(const char *name, const char *scenario, Queue &queue, int items, int burst, int work) {
+	long switches = contextSwitches();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	boost::thread consumer(boost::bind(&consume<Queue>, &queue, items, work));
+	for (int i = 0; i < items; i++) {
+		queue.push(i);
+		if (burst > 0 && i % burst == burst - 1) {
+			boost::this_thread::sleep(boost::posix_time::microseconds(200));
+		}
+	}
+	consumer.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	printf("%-14s %-10s items=%d elapsed=%.3fs throughput=%.0f items/s notifies=%lu context_switches=%ld\n",
+		name, scenario, items, elapsed.count(), items / elapsed.count(), (unsigned long) queue.notifies(), contextSwitches() - switches);
+}
+
+template <class Queue>
+void scenarios(const char *name, int items) {
+	{
+		Queue queue;
+		run(name, "stream", queue, items, 0, 0);
+	}
+	{
+		Queue queue;
+		run(name, "backlog", queue, items, 0, 200);
+	}
+	{
+		Queue queue;
+		run(name, "bursty", queue, items / 10, 1000, 0);
+	}
+}
+
+int main(int argc, char **argv) {
+	int items = argc > 1 ? atoi(argv[1]) : 2000000;
+
+	scenarios<ReferenceQueue<false> >("always-notify", items);
+	scenarios<ReferenceQueue<true> >("waiter-aware", items);
+	scenarios<FailoverQueueInt>("FailoverQueue", items);
+
+	return 0;
+}
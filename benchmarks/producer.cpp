@@ -0,0 +1,87 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures the throughput of several producer threads pushing small items
+** into one queue drained by a single consumer, pushing each item with push()
+** and through Producer handles that add items in batches.
+**
+** Usage: bench_producer [producers] [items per producer] [batch]
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define BENCH_PATH "./"
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void pushEach(IntQueue *queue, int items) {
+	for (int i = 0; i < items; i++) {
+		queue->push(i);
+	}
+}
+
+void pushBatched(IntQueue *queue, int items, int batch) {
+	IntQueue::Producer producer = queue->producer(batch);
+	for (int i = 0; i < items; i++) {
+		producer.push(i);
+	}
+}
+
+void run(const char *name, int producers, int items, int batch) {
+	IntQueue queue(BENCH_PATH, 100000000);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	boost::thread_group threads;
+	for (int p = 0; p < producers; p++) {
+		if (batch > 0) {
+			threads.create_thread(boost::bind(&pushBatched, &queue, items, batch));
+		} else {
+			threads.create_thread(boost::bind(&pushEach, &queue, items));
+		}
+	}
+	for (long i = 0; i < (long) producers * items; i++) {
+		queue.popw();
+	}
+	threads.join_all();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	printf("%-8s producers=%d items=%d batch=%d elapsed=%.3fs throughput=%.0f items/s\n",
+		name, producers, producers * items, batch, elapsed.count(), producers * items / elapsed.count());
+}
+
+int main(int argc, char **argv) {
+	int producers = argc > 1 ? atoi(argv[1]) : 4;
+	int items = argc > 2 ? atoi(argv[2]) : 250000;
+	int batch = argc > 3 ? atoi(argv[3]) : FQ_PRODUCER_BATCH;
+
+	run("push", producers, items, 0);
+	run("producer", producers, items, batch);
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures the throughput of draining a queue whose content has been spilled
+** into failover files. Every popw() that crosses the low-threshold reloads a
+** failover file, so the drain rate is dominated by fill() and by the factory
+** used to allocate the reloaded items.
+** 
+** Usage: bench_reload [items] [maxSize]
+*/
+
+#include <boost/shared_ptr.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#define BENCH_PATH "./"
+
+class Record {
+public:
+	Record() : id_(0) { }
+	explicit Record(int id) : id_(id), name_("failoverqueue-record") { }
+	int id() const { return id_; }
+private:
+	friend class boost::serialization::access;
+
+	int id_;
+	std::string name_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & id_;
+		ar & name_;
+	}
+};
+
+typedef boost::shared_ptr<Record> RecordPtr;
+typedef std::shared_ptr<Record> StdRecordPtr;
+
+//! Allocates every reloaded item and its reference count separately.
+struct NewFactory {
+	RecordPtr operator()(const Record &item) const {
+		return RecordPtr(new Record(item));
+	}
+};
+
+void reset() {
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(BENCH_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find(FQ_FILENAME) == 0) {
+				boost::filesystem::remove(dir_itr->path());
+			}
+		}
+	}
+}
+
+template <class Pointer, class Factory>
+void run(const char *name, int items, int maxSize) {
+	reset();
+	FailoverQueue<Record, Pointer, Factory> queue(BENCH_PATH, maxSize);
+	for (int i = 0; i < items; i++) {
+		queue.push(Pointer(new Record(i)));
+	}
+	int spilled = items - queue.size();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < items; i++) {
+		queue.popw();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	printf("%-10s items=%d reloaded=%d elapsed=%.3fs throughput=%.0f items/s\n",
+		name, items, spilled, elapsed.count(), items / elapsed.count());
+}
+
+int main(int argc, char **argv) {
+	int items = argc > 1 ? atoi(argv[1]) : 50000;
+	int maxSize = argc > 2 ? atoi(argv[2]) : 1000;
+
+	run<RecordPtr, NewFactory>("new", items, maxSize);
+	run<RecordPtr, fq_default_factory<Record, RecordPtr> >("allocate", items, maxSize);
+	run<StdRecordPtr, fq_default_factory<Record, StdRecordPtr> >("std", items, maxSize);
+	run<RecordPtr, fq_pool_factory<Record> >("pool", items, maxSize);
+	reset();
+
+	return 0;
+}
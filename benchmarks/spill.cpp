@@ -0,0 +1,149 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures the spill path of push() and the reload path of fill() with a
+** sweep of spill batch sizes. A spill writes FQ_DUMP_SIZE(maxSize) items, so
+** the batch size is swept through maxSize. For each batch size the queue is
+** filled with items until it has spilled most of them, then drained, and the
+** spill and reload counters give MB/s, items/s and the mean time per file.
+** Built with FQ_HISTOGRAMS, so the 99th percentile per file is reported too.
+**
+** bench_spill writes text archives and bench_spill_binary binary archives.
+** Point the directory at a tmpfs mount such as /dev/shm/ or at a directory on
+** a real disk to compare storage. Without sync the timings reflect the page
+** cache; with sync the files are flushed to the device after each run and
+** the flush time is reported separately.
+**
+** Usage: bench_spill [directory] [items] [payload bytes] [batch sizes, comma separated] [sync]
+*/
+
+#include <boost/shared_ptr.hpp>
+#include <boost/serialization/string.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#define BENCH_STRING(X) #X
+#define BENCH_EXPAND(X) BENCH_STRING(X)
+
+class Record {
+public:
+	Record() : id_(0) { }
+	Record(int id, std::size_t bytes) : id_(id), data_(bytes, 'x') { }
+private:
+	friend class boost::serialization::access;
+
+	int id_;
+	std::string data_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & id_;
+		ar & data_;
+	}
+};
+
+typedef boost::shared_ptr<Record> RecordPtr;
+typedef FailoverQueue<Record, RecordPtr> RecordQueue;
+
+void reset(const std::string &path) {
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(path); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find(FQ_FILENAME) == 0) {
+				boost::filesystem::remove(dir_itr->path());
+			}
+		}
+	}
+}
+
+double mbPerSecond(unsigned long long bytes, unsigned long long nanos) {
+	return nanos > 0 ? bytes / 1048576.0 / (nanos / 1e9) : 0;
+}
+
+double perSecond(unsigned long items, unsigned long long nanos) {
+	return nanos > 0 ? items / (nanos / 1e9) : 0;
+}
+
+void run(const std::string &path, int items, int payload, int batch, bool flush) {
+	reset(path);
+	// FQ_DUMP_SIZE(maxSize) is maxSize / 2 by default.
+	RecordQueue queue(path, batch * 2);
+	for (int i = 0; i < items; i++) {
+		queue.push(RecordPtr(new Record(i, payload)));
+	}
+	double syncSeconds = 0;
+	if (flush) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		sync();
+		syncSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	for (int i = 0; i < items; i++) {
+		queue.popw();
+	}
+
+	fq_stats stats = queue.stats();
+	fq_histogram_snapshot spills = queue.latency(fq_latency_spill);
+	fq_histogram_snapshot reloads = queue.latency(fq_latency_reload);
+	printf("batch=%-6d files=%-5lu spill: %8.1f MB/s %10.0f items/s %8.0f us/file p99=%8.0f us   reload: %8.1f MB/s %10.0f items/s %8.0f us/file p99=%8.0f us",
+		batch, stats.spills,
+		mbPerSecond(stats.bytesSpilled, stats.spillNanos), perSecond(stats.itemsSpilled, stats.spillNanos),
+		spills.mean() / 1000, spills.percentile(99) / 1000.0,
+		mbPerSecond(stats.bytesReloaded, stats.reloadNanos), perSecond(stats.itemsReloaded, stats.reloadNanos),
+		reloads.mean() / 1000, reloads.percentile(99) / 1000.0);
+	if (flush) {
+		printf("   sync: %.3fs", syncSeconds);
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	std::string path = argc > 1 ? argv[1] : "./";
+	int items = argc > 2 ? atoi(argv[2]) : 100000;
+	int payload = argc > 3 ? atoi(argv[3]) : 64;
+	const char *batches = argc > 4 ? argv[4] : "16,64,256,1024,4096,16384";
+	bool flush = argc > 5 && strcmp(argv[5], "sync") == 0;
+
+	if (path.empty() || path[path.size() - 1] != '/') {
+		path += "/";
+	}
+	printf("archive=%s directory=%s items=%d payload=%d\n", BENCH_EXPAND(FQ_OARCHIVE), path.c_str(), items, payload);
+	for (const char *p = batches; p; p = strchr(p, ',') ? strchr(p, ',') + 1 : 0) {
+		int batch = atoi(p);
+		if (batch > 0 && batch * 2 < items) {
+			run(path, items, payload, batch, flush);
+		}
+	}
+	reset(path);
+
+	return 0;
+}
@@ -0,0 +1,278 @@
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+/*
+** Measures push/pop throughput and push to pop latency over a matrix of
+** producer and consumer thread counts, payload sizes and maxSize settings,
+** in three regimes:
+**
+**   memory  Producers and consumers run together and maxSize is raised above
+**           the item count, so nothing is spilled.
+**   spill   Producers and consumers run together. Consumers start once the
+**           first failover file has been written, so the queue keeps spilling
+**           and reloading while it is drained.
+**   drain   Producers fill the queue first, spilling into failover files, and
+**           only the consumers draining it are timed.
+**
+** Results are written as JSON, one object per run, so that the output of two
+** versions can be compared. The item count of a run is capped so payloads add
+** up to no more than the byte limit.
+**
+** Usage: bench_suite [--producers 1,4,16,64] [--consumers 1,4] [--payloads 8,1024,65536]
+**                    [--max-sizes 1000,10000] [--regimes memory,spill,drain]
+**                    [--items N] [--bytes N] [--output file.json]
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/serialization/string.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BENCH_PATH "./"
+#define BENCH_STRING(X) #X
+#define BENCH_EXPAND(X) BENCH_STRING(X)
+
+class Payload {
+public:
+	Payload() : sent_(0) { }
+	explicit Payload(std::size_t bytes) : sent_(fq_now_nanos()), data_(bytes, 'x') { }
+	unsigned long long sent() const { return sent_; }
+	std::size_t bytes() const { return data_.size(); }
+private:
+	friend class boost::serialization::access;
+
+	unsigned long long sent_;
+	std::string data_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & sent_;
+		ar & data_;
+	}
+};
+
+template <>
+struct fq_size_estimator<Payload> {
+	static std::size_t size(const Payload &item) {
+		return sizeof(Payload) + item.bytes();
+	}
+};
+
+typedef boost::shared_ptr<Payload> PayloadPtr;
+typedef FailoverQueue<Payload, PayloadPtr> PayloadQueue;
+
+struct Run {
+	const char *regime;
+	int producers;
+	int consumers;
+	int payload;
+	int maxSize;
+	long items;
+};
+
+struct Shared {
+	PayloadQueue *queue;
+	std::atomic<long> claimed;
+	std::atomic<int> producing;
+	std::atomic<bool> go;
+	fq_histogram latency;
+};
+
+void reset() {
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(BENCH_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find(FQ_FILENAME) == 0) {
+				boost::filesystem::remove(dir_itr->path());
+			}
+		}
+	}
+}
+
+std::vector<int> parseList(const char *text) {
+	std::vector<int> values;
+	for (const char *p = text; *p; ) {
+		values.push_back(atoi(p));
+		p = strchr(p, ',');
+		if (!p) {
+			break;
+		}
+		++p;
+	}
+	return values;
+}
+
+void produce(Shared *shared, long items, int payload) {
+	for (long i = 0; i < items; i++) {
+		shared->queue->push(PayloadPtr(new Payload(payload)));
+	}
+	--shared->producing;
+}
+
+void consume(Shared *shared, long total) {
+	// Consumers in the spill regime hold off until the queue has spilled, or there is nothing left to spill.
+	while (!shared->go.load()) {
+		if (shared->queue->stats().spills > 0 || shared->producing.load() == 0) {
+			shared->go.store(true);
+		} else {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	}
+	while (shared->claimed.fetch_add(1) < total) {
+		PayloadPtr item = shared->queue->popw();
+		shared->latency.record(fq_now_nanos() - item->sent());
+	}
+}
+
+void report(FILE *out, bool first, const Run &run, double elapsed, const fq_stats &stats, const fq_histogram_snapshot &latency) {
+	fprintf(out, "%s\n    {\"regime\": \"%s\", \"producers\": %d, \"consumers\": %d, \"payload\": %d, \"max_size\": %d, \"items\": %ld,",
+		first ? "" : ",", run.regime, run.producers, run.consumers, run.payload, run.maxSize, run.items);
+	fprintf(out, " \"seconds\": %.6f, \"items_per_second\": %.0f, \"mb_per_second\": %.2f,",
+		elapsed, run.items / elapsed, run.items * (double) run.payload / elapsed / 1048576);
+	fprintf(out, " \"latency_ns\": {\"mean\": %.0f, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu},",
+		latency.mean(), latency.percentile(50), latency.percentile(99), latency.percentile(99.9), latency.max());
+	fprintf(out, " \"spills\": %lu, \"reloads\": %lu, \"bytes_spilled\": %llu}",
+		stats.spills, stats.reloads, stats.bytesSpilled);
+	fflush(out);
+}
+
+void run(FILE *out, bool first, Run run) {
+	reset();
+	PayloadQueue queue(BENCH_PATH, run.maxSize);
+	Shared shared;
+	shared.queue = &queue;
+	shared.claimed.store(0);
+	shared.producing.store(run.producers);
+	shared.go.store(strcmp(run.regime, "spill") != 0);
+
+	long perProducer = run.items / run.producers;
+	run.items = perProducer * run.producers;
+	bool drain = strcmp(run.regime, "drain") == 0;
+
+	boost::thread_group producers;
+	boost::thread_group consumers;
+	if (drain) {
+		for (int p = 0; p < run.producers; p++) {
+			producers.create_thread(boost::bind(&produce, &shared, perProducer, run.payload));
+		}
+		producers.join_all();
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int c = 0; c < run.consumers; c++) {
+		consumers.create_thread(boost::bind(&consume, &shared, run.items));
+	}
+	if (!drain) {
+		for (int p = 0; p < run.producers; p++) {
+			producers.create_thread(boost::bind(&produce, &shared, perProducer, run.payload));
+		}
+		producers.join_all();
+	}
+	consumers.join_all();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	report(out, first, run, elapsed.count(), queue.stats(), shared.latency.snapshot());
+}
+
+int main(int argc, char **argv) {
+	std::vector<int> producers = parseList("1,4,16,64");
+	std::vector<int> consumers = parseList("1,4");
+	std::vector<int> payloads = parseList("8,1024,65536");
+	std::vector<int> maxSizes = parseList("1000,10000");
+	std::string regimes = "memory,spill,drain";
+	long items = 20000;
+	long long bytes = 64LL * 1048576;
+	const char *output = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--producers") == 0) {
+			producers = parseList(argv[i + 1]);
+		} else if (strcmp(argv[i], "--consumers") == 0) {
+			consumers = parseList(argv[i + 1]);
+		} else if (strcmp(argv[i], "--payloads") == 0) {
+			payloads = parseList(argv[i + 1]);
+		} else if (strcmp(argv[i], "--max-sizes") == 0) {
+			maxSizes = parseList(argv[i + 1]);
+		} else if (strcmp(argv[i], "--regimes") == 0) {
+			regimes = argv[i + 1];
+		} else if (strcmp(argv[i], "--items") == 0) {
+			items = atol(argv[i + 1]);
+		} else if (strcmp(argv[i], "--bytes") == 0) {
+			bytes = atoll(argv[i + 1]);
+		} else if (strcmp(argv[i], "--output") == 0) {
+			output = argv[i + 1];
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	FILE *out = output ? fopen(output, "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Cannot write: %s\n", output);
+		return 1;
+	}
+	fprintf(out, "{\n  \"benchmark\": \"bench_suite\",\n  \"hardware_threads\": %u,\n", boost::thread::hardware_concurrency());
+	fprintf(out, "  \"config\": {\"FQ_BLOCK_SIZE\": %d, \"FQ_FIELD_ALIGN\": \"%s\", \"FQ_HISTOGRAMS\": %d, \"FQ_LOCK_PROFILING\": %d},\n",
+		FQ_BLOCK_SIZE, BENCH_EXPAND(FQ_FIELD_ALIGN), FQ_HISTOGRAMS, FQ_LOCK_PROFILING);
+	fprintf(out, "  \"results\": [");
+
+	const char *names[] = { "memory", "spill", "drain" };
+	bool first = true;
+	for (int r = 0; r < 3; r++) {
+		if (("," + regimes + ",").find(std::string(",") + names[r] + ",") == std::string::npos) {
+			continue;
+		}
+		bool memory = r == 0;
+		for (std::size_t s = 0; s < payloads.size(); s++) {
+			long capped = std::max(1L, std::min(items, (long) (bytes / std::max(payloads[s], 1))));
+			// Nothing spills in memory, so maxSize only matters to the other regimes.
+			std::size_t sizes = memory ? 1 : maxSizes.size();
+			for (std::size_t m = 0; m < sizes; m++) {
+				for (std::size_t p = 0; p < producers.size(); p++) {
+					for (std::size_t c = 0; c < consumers.size(); c++) {
+						Run settings = { names[r], producers[p], consumers[c], payloads[s], memory ? (int) capped + 1 : maxSizes[m], capped };
+						run(out, first, settings);
+						first = false;
+					}
+				}
+			}
+		}
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout) {
+		fclose(out);
+	}
+	reset();
+
+	return 0;
+}
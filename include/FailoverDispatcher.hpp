@@ -0,0 +1,280 @@
+#ifndef __FAILOVERDISPATCHER_H__
+#define __FAILOVERDISPATCHER_H__
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include "FailoverQueue.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*! \def FQ_DISPATCH_BATCH
+*** The largest number of items a FailoverDispatcher worker passes to the handler at once.
+**/
+#ifndef FQ_DISPATCH_BATCH
+#define FQ_DISPATCH_BATCH 64
+#endif
+
+/*! \def FQ_DISPATCH_WAIT
+*** The number of milliseconds an idle FailoverDispatcher worker waits for items before checking whether it should stop.
+**/
+#ifndef FQ_DISPATCH_WAIT
+#define FQ_DISPATCH_WAIT 50
+#endif
+
+/*! \def FQ_DISPATCH_INTERVAL
+*** The default number of milliseconds between FailoverDispatcher scaling decisions.
+**/
+#ifndef FQ_DISPATCH_INTERVAL
+#define FQ_DISPATCH_INTERVAL 100
+#endif
+
+/*!
+ * \brief Handler call counters of a FailoverDispatcher.
+**/
+struct fq_dispatch_stats {
+	//! The number of handler calls.
+	unsigned long batches;
+	//! The number of items passed to the handler.
+	unsigned long items;
+	//! The total time spent in the handler, in nanoseconds.
+	unsigned long long handlerNanos;
+	//! The longest handler call, in nanoseconds.
+	unsigned long long maxHandlerNanos;
+	//! The number of workers pulling items.
+	int workers;
+};
+
+/*!
+ * \class FailoverDispatcher
+ * \brief A pool of worker threads that pass batches of items from a FailoverQueue to a handler.
+ *
+ * Each worker pops up to a batch of items with the timed, batched popw()
+ * and calls the handler with them, so reloaded failover files are consumed
+ * in batches too. Handlers run concurrently on different workers and must
+ * not throw.
+ *
+ * With scale() the dispatcher keeps between a minimum and a maximum number
+ * of workers busy. Every interval it compares the queue backlog, in memory
+ * and in failover files, with the number of items the busy workers take per
+ * batch: it wakes one more worker while the backlog exceeds that and parks
+ * one while the backlog is smaller than a single batch. Worker threads are
+ * created by start() and parked rather than destroyed.
+ *
+ * Workers can be pinned to processors, worker i running on processor i
+ * modulo the processor count, on Linux. stats() reports handler calls and
+ * their latency.
+ *
+ * stop() returns once every worker has finished its current batch; items
+ * still queued stay in the queue. A queue must not be cleared while a
+ * dispatcher is running over it.
+ *
+ *  \author Nick Gerakines <ngerakines@blizzard.com>
+ *  \version 0.2.0
+**/
+template <class BaseClass, class BaseClassPointer, class Factory = fq_default_factory<BaseClass, BaseClassPointer> >
+class FailoverDispatcher {
+	public:
+		typedef FailoverQueue<BaseClass, BaseClassPointer, Factory> queue_type;
+		typedef std::function<void(std::vector<BaseClassPointer> &)> handler_type;
+
+	private:
+		queue_type &queue_;
+		handler_type handler_;
+		std::size_t batch_;
+		int minWorkers_;
+		int maxWorkers_;
+		long interval_;
+		bool pin_;
+
+		std::vector<boost::shared_ptr<boost::thread> > threads_;
+
+		// Parked workers and the scaling thread wait on condition_.
+		boost::mutex mutex_;
+		boost::condition_variable condition_;
+		std::atomic<int> active_;
+		std::atomic<bool> stopping_;
+
+		FQ_FIELD_ALIGN std::atomic<unsigned long> batches_;
+		std::atomic<unsigned long> items_;
+		std::atomic<unsigned long long> handlerNanos_;
+		std::atomic<unsigned long long> maxHandlerNanos_;
+
+	public:
+		//! Construct a dispatcher with a fixed number of workers.
+		/*! \param queue The queue items are popped from.
+		 *  \param handler Called with each batch of popped items.
+		 *  \param workers The number of worker threads.
+		 *  \param batch The largest number of items passed to the handler at once.
+		**/
+		FailoverDispatcher(queue_type &queue, handler_type handler, int workers = 1, std::size_t batch = FQ_DISPATCH_BATCH) : queue_(queue), handler_(handler), batch_(batch > 0 ? batch : 1), minWorkers_(workers), maxWorkers_(workers), interval_(FQ_DISPATCH_INTERVAL), pin_(false), active_(0), stopping_(false), batches_(0), items_(0), handlerNanos_(0), maxHandlerNanos_(0) { }
+
+		//! The deconstructor stops the workers.
+		~FailoverDispatcher() {
+			stop();
+		}
+
+		//! Lets the number of busy workers follow the queue backlog. Must be called before start().
+		/*! \param minWorkers The number of workers kept busy when the queue is idle.
+		 *  \param maxWorkers The largest number of busy workers.
+		 *  \param interval The number of milliseconds between scaling decisions.
+		**/
+		void scale(int minWorkers, int maxWorkers, long interval = FQ_DISPATCH_INTERVAL) {
+			minWorkers_ = std::max(minWorkers, 1);
+			maxWorkers_ = std::max(maxWorkers, minWorkers_);
+			interval_ = interval;
+		}
+
+		//! Pins each worker to one processor. Must be called before start().
+		void pin(bool pin) {
+			pin_ = pin;
+		}
+
+		//! Starts the worker threads.
+		void start() {
+			if (!threads_.empty()) {
+				return;
+			}
+			stopping_ = false;
+			active_ = minWorkers_;
+			for (int i = 0; i < maxWorkers_; i++) {
+				threads_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&FailoverDispatcher::work, this, i))));
+			}
+			if (maxWorkers_ > minWorkers_) {
+				threads_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&FailoverDispatcher::supervise, this))));
+			}
+		}
+
+		//! Stops the worker threads once their current batches are handled.
+		void stop() {
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				stopping_ = true;
+				condition_.notify_all();
+			}
+			for (int i = 0; i < (int) threads_.size(); i++) {
+				threads_[i]->join();
+			}
+			threads_.clear();
+		}
+
+		//! Returns the number of workers pulling items.
+		int workers() const {
+			return active_.load();
+		}
+
+		//! Returns the handler call counters.
+		fq_dispatch_stats stats() const {
+			fq_dispatch_stats stats;
+			stats.batches = batches_.load();
+			stats.items = items_.load();
+			stats.handlerNanos = handlerNanos_.load();
+			stats.maxHandlerNanos = maxHandlerNanos_.load();
+			stats.workers = active_.load();
+			return stats;
+		}
+
+	private:
+		/*! \brief The loop of worker index: pop a batch, handle it, repeat.
+		 *  \private
+		**/
+		void work(int index) {
+			if (pin_) {
+				pinThread(index);
+			}
+			std::vector<BaseClassPointer> items;
+			items.reserve(batch_);
+			while (!stopping_) {
+				if (index >= active_) {
+					boost::mutex::scoped_lock lock(mutex_);
+					while (index >= active_ && !stopping_) {
+						condition_.wait(lock);
+					}
+					continue;
+				}
+				items.clear();
+				if (queue_.popw(items, batch_, FQ_DISPATCH_WAIT) == 0) {
+					continue;
+				}
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				handler_(items);
+				unsigned long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				batches_.fetch_add(1, std::memory_order_relaxed);
+				items_.fetch_add(items.size(), std::memory_order_relaxed);
+				handlerNanos_.fetch_add(elapsed, std::memory_order_relaxed);
+				unsigned long long longest = maxHandlerNanos_.load(std::memory_order_relaxed);
+				while (elapsed > longest && !maxHandlerNanos_.compare_exchange_weak(longest, elapsed, std::memory_order_relaxed));
+			}
+		}
+
+		/*! \brief The scaling loop: wake or park one worker per interval based on the backlog.
+		 *  \private
+		**/
+		void supervise() {
+			boost::mutex::scoped_lock lock(mutex_);
+			while (!stopping_) {
+				condition_.timed_wait(lock, boost::get_system_time() + boost::posix_time::milliseconds(interval_));
+				if (stopping_) {
+					break;
+				}
+				long backlog = queue_.backlog();
+				int active = active_;
+				if (backlog > (long) (active * batch_) && active < maxWorkers_) {
+					active_ = active + 1;
+					condition_.notify_all();
+				} else if (backlog < (long) batch_ && active > minWorkers_) {
+					active_ = active - 1;
+				}
+			}
+		}
+
+		/*! \brief Pin the calling worker thread to one processor.
+		 *  \private
+		**/
+		static void pinThread(int index) {
+#ifdef __linux__
+			unsigned int cpus = boost::thread::hardware_concurrency();
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(index % (cpus > 0 ? cpus : 1), &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+			(void) index;
+#endif
+		}
+
+		FailoverDispatcher(const FailoverDispatcher &);
+		FailoverDispatcher &operator=(const FailoverDispatcher &);
+};
+
+#endif
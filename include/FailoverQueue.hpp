@@ -25,19 +25,125 @@
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/collection_size_type.hpp>
+#include <boost/serialization/item_version_type.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/pool/pool_alloc.hpp>
 
+#include <deque>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <string>
-#include <queue>
+#include <memory>
+#include <new>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <type_traits>
+#include <utility>
+
+/*! \def FQ_HISTOGRAMS
+*** Set to 1 to record latency histograms for push, popw, spills, reloads and time in queue. Off by default.
+**/
+#ifndef FQ_HISTOGRAMS
+#define FQ_HISTOGRAMS 0
+#endif
+
+/*! \def FQ_HISTOGRAM_STRIPES
+*** The number of per-thread stripes each latency histogram is split into.
+**/
+#ifndef FQ_HISTOGRAM_STRIPES
+#define FQ_HISTOGRAM_STRIPES 4
+#endif
+
+/*! \def FQ_LOCK_PROFILING
+*** Set to 1 to record how long threads wait for and hold the queue lock, by call site. Off by default.
+**/
+#ifndef FQ_LOCK_PROFILING
+#define FQ_LOCK_PROFILING 0
+#endif
+
+/*! \def FQ_TRACE
+*** Set to 1 to record spills, reloads, lock waits and blocked threads in a ring of trace events. Off by default.
+**/
+#ifndef FQ_TRACE
+#define FQ_TRACE 0
+#endif
+
+/*! \def FQ_TRACE_EVENTS
+*** The number of trace events the ring holds before the oldest are overwritten. Must be a power of two.
+**/
+#ifndef FQ_TRACE_EVENTS
+#define FQ_TRACE_EVENTS 65536
+#endif
+
+/*! \def FQ_COUNT_NOTIFIES
+*** Set to 1 to count the signals sent to consumers blocked in popw(), for benchmarks. Off by default.
+**/
+#ifndef FQ_COUNT_NOTIFIES
+#define FQ_COUNT_NOTIFIES 0
+#endif
+
+/*! \def FQ_TRACE_LOCK_WAIT
+*** The shortest lock wait, in nanoseconds, that is recorded as a trace event, so uncontended locking does not flood the ring.
+**/
+#ifndef FQ_TRACE_LOCK_WAIT
+#define FQ_TRACE_LOCK_WAIT 1000
+#endif
+
+/*! \def FQ_COROUTINES
+*** Set to 1 when the compiler supports C++20 coroutines, enabling async_pop() and async_push(). Define it as 0 to leave them out.
+**/
+#ifndef FQ_COROUTINES
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define FQ_COROUTINES 1
+#else
+#define FQ_COROUTINES 0
+#endif
+#endif
+
+#if FQ_COROUTINES
+#include <coroutine>
+#include <functional>
+#endif
+
+/*! \def FQ_EVENTFD
+*** Set to 1 on Linux, enabling readyFd(). Define it as 0 to leave it out.
+**/
+#ifndef FQ_EVENTFD
+#ifdef __linux__
+#define FQ_EVENTFD 1
+#else
+#define FQ_EVENTFD 0
+#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+#if FQ_EVENTFD
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 /*! \def FQ_FILENAME
 *** The prefix used when creating and reading failover files.
@@ -53,6 +159,20 @@
 #define FQ_EXT ".log"
 #endif
 
+/*! \def FQ_OARCHIVE
+*** The Boost.Serialization archive failover files are written with. Defaults to the portable text archive.
+**/
+#ifndef FQ_OARCHIVE
+#define FQ_OARCHIVE boost::archive::text_oarchive
+#endif
+
+/*! \def FQ_IARCHIVE
+*** The Boost.Serialization archive failover files are read with. Must match FQ_OARCHIVE.
+**/
+#ifndef FQ_IARCHIVE
+#define FQ_IARCHIVE boost::archive::text_iarchive
+#endif
+
 /*! \def FQ_MIN_SIZE(N)
 *** A function that returns the low-threshold point at which failover files are read.
 **/
@@ -67,203 +187,2519 @@
 #define FQ_DUMP_SIZE(N) N / 2
 #endif
 
-#define DEBUG 1
+/*! \def FQ_MIN_BYTES(N)
+*** A function that returns the low-threshold, in bytes, at which failover files are read when a byte budget is set.
+**/
+#ifndef FQ_MIN_BYTES
+#define FQ_MIN_BYTES(N) N * 0.25
+#endif
+
+/*! \def FQ_DUMP_BYTES(N)
+*** A function that returns the number of bytes to put into a failover file when a byte budget is set.
+**/
+#ifndef FQ_DUMP_BYTES
+#define FQ_DUMP_BYTES(N) N / 2
+#endif
+
+/*! \def FQ_BLOCK_SIZE
+*** The number of items held by each block of the in-memory queue.
+**/
+#ifndef FQ_BLOCK_SIZE
+#define FQ_BLOCK_SIZE 64
+#endif
+
+/*! \def FQ_CACHE_LINE
+*** The cache line size, in bytes, that in-memory blocks are aligned to.
+**/
+#ifndef FQ_CACHE_LINE
+#define FQ_CACHE_LINE 64
+#endif
+
+/*! \def FQ_FIELD_ALIGN
+*** Starts a group of FailoverQueue members on a new cache line. Define it empty to pack the members.
+**/
+#ifndef FQ_FIELD_ALIGN
+#define FQ_FIELD_ALIGN alignas(FQ_CACHE_LINE)
+#endif
+
+/*! \def FQ_SPIN_LIMIT
+*** The largest number of iterations popw() spins for before blocking when spinning is enabled.
+**/
+#ifndef FQ_SPIN_LIMIT
+#define FQ_SPIN_LIMIT 4096
+#endif
+
+/*! \def FQ_SPIN_ALWAYS
+*** Set to 1 to let popw() spin on a single processor machine too, where it otherwise always blocks. Meant for tests.
+**/
+#ifndef FQ_SPIN_ALWAYS
+#define FQ_SPIN_ALWAYS 0
+#endif
+
+/*! \def FQ_PRODUCER_BATCH
+*** The number of items a Producer handle buffers before flushing them into the queue.
+**/
+#ifndef FQ_PRODUCER_BATCH
+#define FQ_PRODUCER_BATCH 64
+#endif
+
+/*! \def FQ_PRODUCER_DEADLINE
+*** The number of microseconds a Producer handle holds buffered items before a push flushes them.
+**/
+#ifndef FQ_PRODUCER_DEADLINE
+#define FQ_PRODUCER_DEADLINE 1000
+#endif
+
+/*! \def FQ_LOG_LEVEL
+*** The most verbose fq_log_level that is compiled in. The default of 0 removes all logging.
+**/
+#ifndef FQ_LOG_LEVEL
+#define FQ_LOG_LEVEL 0
+#endif
+
+/*!
+ * \brief The severity of a log message.
+**/
+enum fq_log_level {
+	//! A failover file could not be written or read back.
+	fq_log_error = 1,
+	//! Something unexpected was skipped, such as a missing or damaged failover file.
+	fq_log_warn = 2,
+	//! Failover files being written and read back.
+	fq_log_info = 3,
+	//! Everything else.
+	fq_log_debug = 4
+};
+
+/*!
+ * \brief A function that receives log messages.
+**/
+typedef void (*fq_log_function)(fq_log_level level, const char *file, int line, const std::string &message);
+
+/*!
+ * \brief Returns the installed logger. None is installed by default.
+**/
+inline fq_log_function &fq_logger() {
+	static fq_log_function logger = 0;
+	return logger;
+}
+
+/*!
+ * \brief Installs a logger, or removes it when given 0.
+ *
+ * Messages only reach it for levels up to FQ_LOG_LEVEL.
+**/
+inline void fq_set_logger(fq_log_function logger) {
+	fq_logger() = logger;
+}
 
-#ifdef DEBUG
-#include <iostream>
-#define FQD(X) std::cout << __FILE__ << ":" << __LINE__ << " " << X << std::endl;
+/*! \def FQ_LOG(LEVEL, X)
+*** Sends a streamed message to the installed logger. Compiles to nothing for levels above FQ_LOG_LEVEL.
+**/
+#if FQ_LOG_LEVEL > 0
+#define FQ_LOG(LEVEL, X) \
+	do { \
+		if ((LEVEL) <= FQ_LOG_LEVEL && fq_logger()) { \
+			std::ostringstream fq_log_message; \
+			fq_log_message << X; \
+			fq_logger()((LEVEL), __FILE__, __LINE__, fq_log_message.str()); \
+		} \
+	} while (0)
 #else
-#define FQD(X)
+#define FQ_LOG(LEVEL, X) do { } while (0)
 #endif
 
 /*!
- * \class FailoverQueue
- * \brief A thread-safe queue-like container that will spill-over into files on disk.
+ * \brief How popw() waits for an item when the queue is empty.
+**/
+enum fq_wait_strategy {
+	//! Block on the condition variable straight away.
+	fq_wait_block,
+	//! Spin until an item is pushed, never blocking.
+	fq_wait_spin,
+	//! Spin for a self-tuning number of iterations, then block.
+	fq_wait_adaptive
+};
+
+/*!
+ * \brief What push() does when the queue holds more items than its soft limit.
+**/
+enum fq_overflow_policy {
+	//! Accept the item, spilling into failover files beyond maxSize items.
+	fq_overflow_spill,
+	//! Wait for consumers up to the timeout, then accept the item.
+	fq_overflow_block,
+	//! Wait for consumers up to the timeout, then reject the item.
+	fq_overflow_reject
+};
+
+/*!
+ * \brief A snapshot of the counters of a FailoverQueue.
+**/
+struct fq_stats {
+	//! The number of items added to the queue.
+	unsigned long pushed;
+	//! The number of items popped from the queue.
+	unsigned long popped;
+	//! The number of failover files written.
+	unsigned long spills;
+	//! The number of items written to failover files.
+	unsigned long itemsSpilled;
+	//! The number of bytes written to failover files.
+	unsigned long long bytesSpilled;
+	//! The time spent writing failover files, in nanoseconds.
+	unsigned long long spillNanos;
+	//! The number of failover files read back.
+	unsigned long reloads;
+	//! The number of items read back from failover files.
+	unsigned long itemsReloaded;
+	//! The number of bytes read back from failover files.
+	unsigned long long bytesReloaded;
+	//! The time spent reading failover files back, in nanoseconds.
+	unsigned long long reloadNanos;
+	//! The number of failover files that had disappeared when they were due to be read back.
+	unsigned long missingFiles;
+	//! The number of failover files that could not be read back and were removed.
+	unsigned long corruptFiles;
+	//! The summed time popped items spent queued between push and pop, in nanoseconds. Divide by popped for the mean.
+	unsigned long long queuedNanos;
+};
+
+/*!
+ * \brief The ages of the oldest items in each tier of a FailoverQueue, in nanoseconds.
+**/
+struct fq_ages {
+	//! The age of the oldest item held in memory, or 0 if there is none.
+	unsigned long long memory;
+	//! The age of the oldest item in failover files, or 0 if there is none.
+	unsigned long long disk;
+};
+
+/*!
+ * \brief The operations a FailoverQueue records latency histograms for.
+**/
+enum fq_latency {
+	//! push(), emplace() and Producer flushes, including any spill they cause.
+	fq_latency_push,
+	//! The time popw() waits and works for an item.
+	fq_latency_popw,
+	//! Writing one failover file.
+	fq_latency_spill,
+	//! Reading one failover file back.
+	fq_latency_reload,
+	//! The time an item spends queued between push and pop, including any time in failover files.
+	fq_latency_in_queue,
+	fq_latency_count
+};
+
+/*!
+ * \brief Returns a monotonic time in nanoseconds.
+**/
+inline unsigned long long fq_now_nanos() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * \brief Returns a cheap wall clock time in nanoseconds since the epoch, used to stamp pushed items.
  *
- * This project provides a thread-safe queue-like container that has the ability
- * to spill queue content into failover files for later reprocessing. This
- * allows the queus to be fixed sizes (queue length) that periodically write
- * overflow items into files that can be read back and inserted into the queue
- * when the queue has fewer items.
+ * Push times are written into failover files and compared after a restart,
+ * so they come from the real time clock rather than a monotonic one. On
+ * Linux the coarse clock is read, which costs no more than a memory load
+ * but only advances every few milliseconds.
+**/
+inline unsigned long long fq_stamp_nanos() {
+#ifdef CLOCK_REALTIME_COARSE
+	timespec now;
+	clock_gettime(CLOCK_REALTIME_COARSE, &now);
+	return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/*!
+ * \brief Returns the time elapsed since a push stamp, or 0 for an unknown stamp or a clock that stepped back.
+**/
+inline unsigned long long fq_stamp_age(unsigned long long stamp, unsigned long long now) {
+	return stamp != 0 && now > stamp ? now - stamp : 0;
+}
+
+/*!
+ * \brief The log-linear bucket layout of latency histograms.
  *
- * \section Configuration
- * The following define macros can be used to change the behavior of the class
- * if they are defined before the header file is included.
- * \li FQ_FILENAME()
- * \li FQ_EXT()
- * \li FQ_MIN_SIZE(N)
- * \li FQ_DUMP_SIZE(N)
- * 
- *  \author Nick Gerakines <ngerakines@blizzard.com>
- *  \version 0.2.0
+ * Values below 8 have a bucket each. Every larger power of two is split
+ * into 8 buckets, so a bucket is at most 12.5% wide, up to 2^40
+ * nanoseconds; larger values share the last bucket.
 **/
-template <class BaseClass, class BaseClassPointer>
-class FailoverQueue {
+struct fq_histogram_buckets {
+	enum {
+		sub_bits = 3,
+		sub_count = 1 << sub_bits,
+		top_bit = 40,
+		count = (top_bit - sub_bits + 1) * sub_count
+	};
+
+	//! Returns the bucket holding a value.
+	static int index(unsigned long long value) {
+		if (value < (unsigned long long) sub_count) {
+			return (int) value;
+		}
+		int magnitude = 63 - __builtin_clzll(value);
+		if (magnitude >= top_bit) {
+			return count - 1;
+		}
+		return (magnitude - sub_bits + 1) * sub_count + (int) ((value >> (magnitude - sub_bits)) & (sub_count - 1));
+	}
+
+	//! Returns the largest value in a bucket.
+	static unsigned long long upper(int index) {
+		if (index < sub_count) {
+			return index;
+		}
+		int magnitude = index / sub_count + sub_bits - 1;
+		unsigned long long sub = index % sub_count;
+		return ((sub_count + sub + 1) << (magnitude - sub_bits)) - 1;
+	}
+};
+
+/*!
+ * \class fq_histogram_snapshot
+ * \brief The merged content of a latency histogram, in nanoseconds.
+**/
+class fq_histogram_snapshot {
+	public:
+		fq_histogram_snapshot() : counts_(fq_histogram_buckets::count, 0), count_(0), total_(0), max_(0) { }
+
+		//! Returns the number of recorded values.
+		unsigned long count() const { return count_; }
+
+		//! Returns the largest recorded value.
+		unsigned long long max() const { return max_; }
+
+		//! Returns the mean of the recorded values.
+		double mean() const { return count_ > 0 ? (double) total_ / count_ : 0; }
+
+		//! Returns the value below which the given percentage of recorded values fall, to within 12.5%.
+		unsigned long long percentile(double percent) const {
+			if (count_ == 0) {
+				return 0;
+			}
+			unsigned long rank = (unsigned long) (percent / 100 * count_ + 0.5);
+			rank = std::max(rank, 1UL);
+			unsigned long seen = 0;
+			for (int i = 0; i < fq_histogram_buckets::count; i++) {
+				seen += counts_[i];
+				if (seen >= rank) {
+					return std::min(fq_histogram_buckets::upper(i), max_);
+				}
+			}
+			return max_;
+		}
+
+		//! Adds the values of another snapshot.
+		void merge(const fq_histogram_snapshot &other) {
+			for (int i = 0; i < fq_histogram_buckets::count; i++) {
+				counts_[i] += other.counts_[i];
+			}
+			count_ += other.count_;
+			total_ += other.total_;
+			max_ = std::max(max_, other.max_);
+		}
+
+	private:
+		friend class fq_histogram;
+
+		std::vector<unsigned long> counts_;
+		unsigned long count_;
+		unsigned long long total_;
+		unsigned long long max_;
+};
+
+/*!
+ * \brief Returns the histogram stripe of the calling thread.
+**/
+inline unsigned int fq_thread_stripe() {
+	static std::atomic<unsigned int> next(0);
+	static thread_local unsigned int stripe = next.fetch_add(1, std::memory_order_relaxed);
+	return stripe;
+}
+
+/*!
+ * \class fq_histogram
+ * \brief A latency histogram that threads record into without contending.
+ *
+ * Each thread records into one of FQ_HISTOGRAM_STRIPES cache aligned
+ * stripes of relaxed atomic counters; snapshot() merges the stripes.
+**/
+class fq_histogram {
+	public:
+		fq_histogram() {
+			for (int s = 0; s < FQ_HISTOGRAM_STRIPES; s++) {
+				for (int i = 0; i < fq_histogram_buckets::count; i++) {
+					stripes_[s].counts[i].store(0, std::memory_order_relaxed);
+				}
+				stripes_[s].total.store(0, std::memory_order_relaxed);
+				stripes_[s].max.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		//! Records a value.
+		void record(unsigned long long value) {
+			stripe &s = stripes_[fq_thread_stripe() % FQ_HISTOGRAM_STRIPES];
+			s.counts[fq_histogram_buckets::index(value)].fetch_add(1, std::memory_order_relaxed);
+			s.total.fetch_add(value, std::memory_order_relaxed);
+			unsigned long long longest = s.max.load(std::memory_order_relaxed);
+			while (value > longest && !s.max.compare_exchange_weak(longest, value, std::memory_order_relaxed));
+		}
+
+		//! Returns the merged stripes, optionally emptying the histogram as they are read.
+		fq_histogram_snapshot snapshot(bool reset = false) {
+			fq_histogram_snapshot merged;
+			for (int s = 0; s < FQ_HISTOGRAM_STRIPES; s++) {
+				for (int i = 0; i < fq_histogram_buckets::count; i++) {
+					unsigned long count = reset ? stripes_[s].counts[i].exchange(0, std::memory_order_relaxed) : stripes_[s].counts[i].load(std::memory_order_relaxed);
+					merged.counts_[i] += count;
+					merged.count_ += count;
+				}
+				merged.total_ += reset ? stripes_[s].total.exchange(0, std::memory_order_relaxed) : stripes_[s].total.load(std::memory_order_relaxed);
+				merged.max_ = std::max(merged.max_, reset ? stripes_[s].max.exchange(0, std::memory_order_relaxed) : stripes_[s].max.load(std::memory_order_relaxed));
+			}
+			return merged;
+		}
+
+	private:
+		struct alignas(FQ_CACHE_LINE) stripe {
+			std::atomic<unsigned long> counts[fq_histogram_buckets::count];
+			std::atomic<unsigned long long> total;
+			std::atomic<unsigned long long> max;
+		};
+
+		stripe stripes_[FQ_HISTOGRAM_STRIPES];
+
+		fq_histogram(const fq_histogram &);
+		fq_histogram &operator=(const fq_histogram &);
+};
+
+#if FQ_TRACE
+/*!
+ * \class fq_trace_ring
+ * \brief A fixed-size ring of trace events shared by every queue in the process.
+ *
+ * Recording an event claims a slot with one atomic increment and fills it
+ * with relaxed stores; each slot carries the sequence number it was written
+ * for, so dump() skips slots that were being overwritten while it read them.
+ * Event names must be string literals.
+**/
+class fq_trace_ring {
+	public:
+		fq_trace_ring() : next_(0) {
+			for (int i = 0; i < FQ_TRACE_EVENTS; i++) {
+				slots_[i].sequence.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		//! Records an event. phase is 'B' or 'E' to begin or end a span, or 'X' for a span that ends now and lasted duration nanoseconds.
+		void record(char phase, const char *name, unsigned long long duration = 0) {
+			unsigned long long now = fq_now_nanos();
+			unsigned long long sequence = next_.fetch_add(1, std::memory_order_relaxed);
+			slot &s = slots_[sequence & (FQ_TRACE_EVENTS - 1)];
+			s.sequence.store(0, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			s.name.store(name, std::memory_order_relaxed);
+			s.phase.store(phase, std::memory_order_relaxed);
+			s.thread.store(fq_thread_stripe(), std::memory_order_relaxed);
+			s.start.store(phase == 'X' ? now - duration : now, std::memory_order_relaxed);
+			s.duration.store(duration, std::memory_order_relaxed);
+			s.sequence.store(sequence + 1, std::memory_order_release);
+		}
+
+		//! Writes the events held by the ring, oldest first, as Chrome trace JSON.
+		void dump(std::ostream &out) {
+			unsigned long long end = next_.load(std::memory_order_acquire);
+			unsigned long long begin = end > FQ_TRACE_EVENTS ? end - FQ_TRACE_EVENTS : 0;
+			out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			bool first = true;
+			for (unsigned long long sequence = begin; sequence < end; sequence++) {
+				slot &s = slots_[sequence & (FQ_TRACE_EVENTS - 1)];
+				if (s.sequence.load(std::memory_order_acquire) != sequence + 1) {
+					continue;
+				}
+				const char *name = s.name.load(std::memory_order_relaxed);
+				char phase = s.phase.load(std::memory_order_relaxed);
+				unsigned int thread = s.thread.load(std::memory_order_relaxed);
+				unsigned long long start = s.start.load(std::memory_order_relaxed);
+				unsigned long long duration = s.duration.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (s.sequence.load(std::memory_order_relaxed) != sequence + 1) {
+					continue;
+				}
+				out << (first ? "" : ",") << "\n{\"name\":\"" << name << "\",\"cat\":\"failoverqueue\",\"ph\":\"" << phase
+					<< "\",\"pid\":1,\"tid\":" << thread << ",\"ts\":" << start / 1000 << "." << digits(start % 1000);
+				if (phase == 'X') {
+					out << ",\"dur\":" << duration / 1000 << "." << digits(duration % 1000);
+				}
+				out << "}";
+				first = false;
+			}
+			out << "\n]}\n";
+		}
+
+	private:
+		struct slot {
+			std::atomic<unsigned long long> sequence;
+			std::atomic<const char *> name;
+			std::atomic<char> phase;
+			std::atomic<unsigned int> thread;
+			std::atomic<unsigned long long> start;
+			std::atomic<unsigned long long> duration;
+		};
+
+		//! Formats the nanoseconds after the microsecond point, as Chrome traces count in microseconds.
+		static std::string digits(unsigned long long nanos) {
+			char digits[4] = { (char) ('0' + nanos / 100), (char) ('0' + nanos / 10 % 10), (char) ('0' + nanos % 10), 0 };
+			return digits;
+		}
+
+		FQ_FIELD_ALIGN std::atomic<unsigned long long> next_;
+		FQ_FIELD_ALIGN slot slots_[FQ_TRACE_EVENTS];
+
+		fq_trace_ring(const fq_trace_ring &);
+		fq_trace_ring &operator=(const fq_trace_ring &);
+};
+
+/*!
+ * \brief Returns the process wide trace ring.
+**/
+inline fq_trace_ring &fq_trace() {
+	static fq_trace_ring *ring = new fq_trace_ring();
+	return *ring;
+}
+#endif
+
+/*!
+ * \brief Writes the recorded trace events as Chrome trace JSON, for chrome://tracing or Perfetto.
+ *
+ * Without FQ_TRACE an empty trace is written.
+**/
+inline void fq_trace_dump(std::ostream &out) {
+#if FQ_TRACE
+	fq_trace().dump(out);
+#else
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}\n";
+#endif
+}
+
+/*!
+ * \class fq_trace_scope
+ * \brief Records a trace span covering its own lifetime. Compiles to nothing without FQ_TRACE.
+**/
+class fq_trace_scope {
+	public:
+#if FQ_TRACE
+		explicit fq_trace_scope(const char *name) : name_(name) {
+			fq_trace().record('B', name_);
+		}
+
+		~fq_trace_scope() {
+			fq_trace().record('E', name_);
+		}
+
+	private:
+		const char *name_;
+#else
+		explicit fq_trace_scope(const char * /* name */) { }
+#endif
+};
+
+/*!
+ * \brief The places a FailoverQueue takes or holds its lock from, for lock profiling.
+**/
+enum fq_lock_site {
+	//! push(), emplace(), Producer flushes and async_push().
+	fq_lock_push,
+	//! popw(), try_pop() and async_pop().
+	fq_lock_pop,
+	//! Holds during which a failover file was written.
+	fq_lock_spill,
+	//! Holds during which a failover file was read back.
+	fq_lock_reload,
+	//! size(), empty(), the other observers, the setters and clear().
+	fq_lock_observer,
+	fq_lock_site_count
+};
+
+/*!
+ * \brief Returns the name trace events give a lock wait at a site.
+**/
+inline const char *fq_lock_wait_name(fq_lock_site site) {
+	static const char *names[fq_lock_site_count] = { "lock wait: push", "lock wait: pop", "lock wait: spill", "lock wait: reload", "lock wait: observer" };
+	return names[site];
+}
+
+/*!
+ * \brief Record a lock wait as a trace event if it was long enough to matter.
+**/
+inline void fq_trace_wait(fq_lock_site site, unsigned long long start, unsigned long long acquired) {
+#if FQ_TRACE
+	if (acquired - start >= FQ_TRACE_LOCK_WAIT) {
+		fq_trace().record('X', fq_lock_wait_name(site), acquired - start);
+	}
+#else
+	(void) site;
+	(void) start;
+	(void) acquired;
+#endif
+}
+
+#if FQ_LOCK_PROFILING
+/*!
+ * \class fq_mutex
+ * \brief The queue mutex, with histograms of the time spent waiting for and holding it.
+**/
+class fq_mutex : public boost::mutex {
+	public:
+		fq_mutex() : site_(fq_lock_observer), profile_(new profile()) { }
+
+		//! Charges the current hold to a site instead of the one it was taken at. Called with the lock held.
+		void site(fq_lock_site site) { site_ = site; }
+
+		//! Returns the histogram of the time spent waiting for the lock at a site.
+		fq_histogram &waits(fq_lock_site site) { return profile_->waits[site]; }
+
+		//! Returns the histogram of the time the lock was held for at a site.
+		fq_histogram &holds(fq_lock_site site) { return profile_->holds[site]; }
+
 	private:
-		std::queue<BaseClassPointer> theQueue_;
+		friend class fq_lock;
+
+		struct profile {
+			fq_histogram waits[fq_lock_site_count];
+			fq_histogram holds[fq_lock_site_count];
+		};
+
+		fq_lock_site site_;
+		std::unique_ptr<profile> profile_;
+};
+
+/*!
+ * \class fq_lock
+ * \brief A scoped lock on the queue mutex that records its wait and hold times.
+ *
+ * Waiting on a condition variable through wait() and timed_wait() ends
+ * the hold, so time spent blocked is not counted as time held.
+**/
+class fq_lock : public boost::mutex::scoped_lock {
+	public:
+		fq_lock(fq_mutex &mutex, fq_lock_site site) : boost::mutex::scoped_lock(mutex, boost::defer_lock), mutex_(mutex), site_(site), acquired_(0) {
+			lock();
+		}
+
+		~fq_lock() {
+			if (owns_lock()) {
+				unlock();
+			}
+		}
+
+		void lock() {
+			unsigned long long start = fq_now_nanos();
+			boost::mutex::scoped_lock::lock();
+			acquired_ = fq_now_nanos();
+			mutex_.site_ = site_;
+			mutex_.profile_->waits[site_].record(acquired_ - start);
+			fq_trace_wait(site_, start, acquired_);
+		}
+
+		void unlock() {
+			mutex_.profile_->holds[mutex_.site_].record(fq_now_nanos() - acquired_);
+			boost::mutex::scoped_lock::unlock();
+		}
+
+		template <class Condition>
+		void wait(Condition &condition) {
+			mutex_.profile_->holds[mutex_.site_].record(fq_now_nanos() - acquired_);
+			condition.wait(*this);
+			reacquired();
+		}
+
+		template <class Condition>
+		bool timed_wait(Condition &condition, const boost::system_time &deadline) {
+			mutex_.profile_->holds[mutex_.site_].record(fq_now_nanos() - acquired_);
+			bool signalled = condition.timed_wait(*this, deadline);
+			reacquired();
+			return signalled;
+		}
+
+	private:
+		void reacquired() {
+			acquired_ = fq_now_nanos();
+			mutex_.site_ = site_;
+		}
+
+		fq_mutex &mutex_;
+		fq_lock_site site_;
+		unsigned long long acquired_;
+};
+#else
+typedef boost::mutex fq_mutex;
+
+/*!
+ * \class fq_lock
+ * \brief A scoped lock on the queue mutex. Records nothing unless FQ_LOCK_PROFILING is set.
+**/
+class fq_lock : public boost::mutex::scoped_lock {
+	public:
+#if FQ_TRACE
+		fq_lock(fq_mutex &mutex, fq_lock_site site) : boost::mutex::scoped_lock(mutex, boost::defer_lock) {
+			unsigned long long start = fq_now_nanos();
+			lock();
+			fq_trace_wait(site, start, fq_now_nanos());
+		}
+#else
+		fq_lock(fq_mutex &mutex, fq_lock_site /* site */) : boost::mutex::scoped_lock(mutex) { }
+#endif
+
+		template <class Condition>
+		void wait(Condition &condition) {
+			condition.wait(*this);
+		}
+
+		template <class Condition>
+		bool timed_wait(Condition &condition, const boost::system_time &deadline) {
+			return condition.timed_wait(*this, deadline);
+		}
+};
+#endif
+
+/*!
+ * \brief Tell the processor that the calling thread is spinning.
+**/
+inline void fq_cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/*!
+ * \brief Returns true if spinning can help, that is if more than one processor is available, or if FQ_SPIN_ALWAYS is set.
+**/
+inline bool fq_spin_useful() {
+#if FQ_SPIN_ALWAYS
+	return true;
+#else
+	static const bool useful = boost::thread::hardware_concurrency() > 1;
+	return useful;
+#endif
+}
+
+/*!
+ * \brief Add to a statistics counter that is only written with a lock held.
+ *
+ * A relaxed load and store are enough, and cheaper than a read-modify-write,
+ * because the lock already orders the writers.
+**/
+template <class Counter, class Value>
+inline void fq_count(std::atomic<Counter> &counter, Value value) {
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/*!
+ * \class fq_default_factory
+ * \brief Creates BaseClassPointer objects for reloaded and emplaced items.
+ *
+ * The factory is called with the BaseClass constructor arguments; reloaded
+ * items are passed as a BaseClass rvalue. The generic factory allocates each
+ * item with new, which covers raw pointers and std::unique_ptr. When
+ * BaseClassPointer is a boost::shared_ptr or a std::shared_ptr the item and
+ * its reference count are allocated together with allocate_shared.
+**/
+template <class BaseClass, class BaseClassPointer>
+struct fq_default_factory {
+	template <class... Args>
+	BaseClassPointer operator()(Args&&... args) const {
+		return BaseClassPointer(new BaseClass(std::forward<Args>(args)...));
+	}
+};
+
+template <class BaseClass>
+struct fq_default_factory<BaseClass, BaseClass> {
+	template <class... Args>
+	BaseClass operator()(Args&&... args) const {
+		return BaseClass(std::forward<Args>(args)...);
+	}
+};
+
+template <class BaseClass>
+struct fq_default_factory<BaseClass, boost::shared_ptr<BaseClass> > {
+	template <class... Args>
+	boost::shared_ptr<BaseClass> operator()(Args&&... args) const {
+		return boost::allocate_shared<BaseClass>(std::allocator<BaseClass>(), std::forward<Args>(args)...);
+	}
+};
+
+template <class BaseClass>
+struct fq_default_factory<BaseClass, std::shared_ptr<BaseClass> > {
+	template <class... Args>
+	std::shared_ptr<BaseClass> operator()(Args&&... args) const {
+		return std::allocate_shared<BaseClass>(std::allocator<BaseClass>(), std::forward<Args>(args)...);
+	}
+};
+
+/*!
+ * \class fq_pointer_traits
+ * \brief Gives access to the BaseClass object held by a queued BaseClassPointer.
+ *
+ * Queues where BaseClassPointer is the same type as BaseClass store items by
+ * value, so the item is its own BaseClass object.
+**/
+template <class BaseClass, class BaseClassPointer>
+struct fq_pointer_traits {
+	static const BaseClass &get(const BaseClassPointer &item) {
+		return *item;
+	}
+
+	//! Returns the item's object, or 0 for a null pointer.
+	static const BaseClass *address(const BaseClassPointer &item) {
+		return item ? &*item : 0;
+	}
+};
+
+template <class BaseClass>
+struct fq_pointer_traits<BaseClass, BaseClass> {
+	static const BaseClass &get(const BaseClass &item) {
+		return item;
+	}
+
+	static const BaseClass *address(const BaseClass &item) {
+		return &item;
+	}
+};
+
+/*!
+ * \class fq_size_estimator
+ * \brief Estimates the number of bytes an item holds in memory.
+ *
+ * Used for byte budgets. The default is sizeof(BaseClass); specialize it for
+ * types that own variable-sized data.
+**/
+template <class BaseClass>
+struct fq_size_estimator {
+	static std::size_t size(const BaseClass & /* item */) {
+		return sizeof(BaseClass);
+	}
+};
+
+/*!
+ * \class fq_block_queue
+ * \brief A double-ended queue made of fixed-size, cache line aligned blocks.
+ *
+ * Blocks that are emptied by pop_front() or clear() are kept on a free list
+ * and reused by later pushes, so a queue that stays within the number of
+ * blocks it has already allocated makes no further allocations. Blocks are
+ * only returned to the system when the queue is destroyed.
+**/
+template <class T, std::size_t BlockSize = FQ_BLOCK_SIZE>
+class fq_block_queue {
+	private:
+		struct alignas(FQ_CACHE_LINE) block {
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[BlockSize];
+			block *next;
+		};
+
+		block *head_;
+		block *tail_;
+		std::size_t begin_;
+		std::size_t end_;
+		std::size_t size_;
+
+		block *free_;
+		std::size_t blocks_;
+
+	public:
+		class iterator {
+			public:
+				iterator(block *b, std::size_t i, block *tail) : block_(b), index_(i), tail_(tail) { }
+				T &operator*() const { return *reinterpret_cast<T *>(&block_->slots[index_]); }
+				iterator &operator++() {
+					if (++index_ == BlockSize && block_ != tail_) {
+						block_ = block_->next;
+						index_ = 0;
+					}
+					return *this;
+				}
+				bool operator==(const iterator &other) const { return block_ == other.block_ && index_ == other.index_; }
+				bool operator!=(const iterator &other) const { return !(*this == other); }
+			private:
+				block *block_;
+				std::size_t index_;
+				block *tail_;
+		};
+
+		fq_block_queue() : head_(0), tail_(0), begin_(0), end_(0), size_(0), free_(0), blocks_(0) { }
+
+		~fq_block_queue() {
+			clear();
+			release(head_);
+			while (free_) {
+				block *b = free_;
+				free_ = b->next;
+				delete b;
+			}
+		}
+
+		bool empty() const { return size_ == 0; }
+		std::size_t size() const { return size_; }
+
+		//! Returns the number of blocks allocated by the queue, including those on the free list.
+		std::size_t blocks() const { return blocks_; }
+
+		T &front() { return *reinterpret_cast<T *>(&head_->slots[begin_]); }
+
+		iterator begin() { return iterator(head_, begin_, tail_); }
+		iterator end() { return iterator(tail_, end_, tail_); }
+
+		template <class Item>
+		void push_back(Item &&item) {
+			if (!tail_) {
+				reset(acquire());
+			} else if (end_ == BlockSize) {
+				block *b = acquire();
+				tail_->next = b;
+				tail_ = b;
+				end_ = 0;
+			}
+			new (&tail_->slots[end_]) T(std::forward<Item>(item));
+			++end_;
+			++size_;
+		}
+
+		template <class Item>
+		void push_front(Item &&item) {
+			if (!head_) {
+				reset(acquire());
+			} else if (begin_ == 0) {
+				block *b = acquire();
+				b->next = head_;
+				head_ = b;
+				begin_ = BlockSize;
+			}
+			new (&head_->slots[begin_ - 1]) T(std::forward<Item>(item));
+			--begin_;
+			++size_;
+		}
+
+		void pop_front() {
+			front().~T();
+			++begin_;
+			if (--size_ == 0) {
+				// Keep one block and restart in its middle so both ends have room.
+				while (head_ != tail_) {
+					block *b = head_;
+					head_ = head_->next;
+					release(b);
+				}
+				reset(head_);
+			} else if (begin_ == BlockSize) {
+				block *b = head_;
+				head_ = head_->next;
+				release(b);
+				begin_ = 0;
+			}
+		}
+
+		void pop_front(std::size_t count) {
+			while (count-- > 0) {
+				pop_front();
+			}
+		}
+
+		void clear() {
+			pop_front(size_);
+		}
+
+	private:
+		block *acquire() {
+			block *b = free_;
+			if (b) {
+				free_ = b->next;
+			} else {
+				b = new block;
+				++blocks_;
+			}
+			b->next = 0;
+			return b;
+		}
+
+		void release(block *b) {
+			if (b) {
+				b->next = free_;
+				free_ = b;
+			}
+		}
+
+		void reset(block *b) {
+			head_ = tail_ = b;
+			begin_ = end_ = BlockSize / 2;
+		}
+
+		fq_block_queue(const fq_block_queue &);
+		fq_block_queue &operator=(const fq_block_queue &);
+};
+
+/*!
+ * \class fq_range
+ * \brief Writes referenced items in the layout of a std::vector<BaseClass>.
+ *  \private
+**/
+template <class BaseClass>
+class fq_range {
+	public:
+		std::vector<const BaseClass *> items;
+	private:
+		friend class boost::serialization::access;
+		template<class Archive>
+		void save(Archive & ar, const unsigned int /* version */) const {
+			const boost::serialization::collection_size_type count(items.size());
+			ar << BOOST_SERIALIZATION_NVP(count);
+			// Archives that write vectors of primitives as one array, such as binary archives, leave out the item version.
+			typedef typename boost::serialization::use_array_optimization<Archive>::template apply<BaseClass>::type array_optimized;
+			if (!array_optimized::value) {
+				const boost::serialization::item_version_type item_version(boost::serialization::version<BaseClass>::value);
+				ar << BOOST_SERIALIZATION_NVP(item_version);
+			}
+			for (typename std::vector<const BaseClass *>::const_iterator it = items.begin(); it != items.end(); ++it) {
+				ar << boost::serialization::make_nvp("item", **it);
+			}
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+namespace boost {
+namespace serialization {
+
+// Collections of primitive types are written without a class header, so
+// fq_range takes its serialization traits from the vector it stands in for.
+template <class BaseClass>
+struct implementation_level<fq_range<BaseClass> > : implementation_level<std::vector<BaseClass> > { };
+
+template <class BaseClass>
+struct tracking_level<fq_range<BaseClass> > : tracking_level<std::vector<BaseClass> > { };
+
+}
+}
+
+/*!
+ * \class fq_container
+ * \brief A utility class used to create variable-length failover files.
+ *
+ * Items are added by reference and must stay in place until the container has
+ * been saved. Loading fills data, and stamps with the push time of each item.
+ * Files written before version 1 carry no push times and load with empty stamps.
+ *  \private
+**/
+template <class BaseClass>
+class fq_container {
+	public:
+		std::vector<BaseClass> data;
+		std::vector<unsigned long long> stamps;
+		void add(const BaseClass &item, unsigned long long stamp = 0) {
+			pending_.items.push_back(&item);
+			stamps.push_back(stamp);
+		}
+	private:
+		fq_range<BaseClass> pending_;
+
+		friend class boost::serialization::access;
+		template<class Archive>
+		void save(Archive & ar, const unsigned int /* version */) const {
+			ar << pending_;
+			ar << stamps;
+		}
+		template<class Archive>
+		void load(Archive & ar, const unsigned int version) {
+			ar & data;
+			if (version > 0) {
+				ar & stamps;
+			}
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+namespace boost {
+namespace serialization {
+
+// Version 1 added the push times of the items.
+template <class BaseClass>
+struct version<fq_container<BaseClass> > {
+	typedef mpl::int_<1> type;
+	typedef mpl::integral_c_tag tag;
+	BOOST_STATIC_CONSTANT(int, value = version::type::value);
+};
+
+}
+}
+
+/*!
+ * \brief Parse the number that a failover file name ends with, before its extension.
+**/
+inline long fq_failover_id(const std::string &fileName) {
+	std::string::size_type end = fileName.length();
+	std::string::size_type extLength = strlen(FQ_EXT);
+	if (end >= extLength && fileName.compare(end - extLength, extLength, FQ_EXT) == 0) {
+		end -= extLength;
+	}
+	std::string::size_type begin = end;
+	while (begin > 0 && isdigit((unsigned char) fileName[begin - 1])) {
+		--begin;
+	}
+	return atol(fileName.substr(begin, end - begin).c_str());
+}
+
+/*!
+ * \brief Read the size and modification time, in nanoseconds since the epoch, of a failover file.
+ *
+ * On POSIX systems both come from a single stat() call, which matters when a
+ * queue starts up over a directory of many files.
+**/
+inline void fq_file_status(const std::string &fileName, std::size_t &bytes, unsigned long long &modified) {
+#if defined(__APPLE__)
+	struct stat info;
+	if (::stat(fileName.c_str(), &info) == 0) {
+		bytes = info.st_size;
+		modified = (unsigned long long) info.st_mtimespec.tv_sec * 1000000000ULL + info.st_mtimespec.tv_nsec;
+	}
+#elif defined(__unix__)
+	struct stat info;
+	if (::stat(fileName.c_str(), &info) == 0) {
+		bytes = info.st_size;
+		modified = (unsigned long long) info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec;
+	}
+#else
+	boost::filesystem::path path(fileName);
+	bytes = (std::size_t) boost::filesystem::file_size(path);
+	modified = (unsigned long long) boost::filesystem::last_write_time(path) * 1000000000ULL;
+#endif
+}
+
+/*!
+ * \class fq_pool_factory
+ * \brief A factory that allocates reloaded items from a shared slab pool.
+ *
+ * Items and their reference counts are carved out of a boost::fast_pool_allocator
+ * singleton pool. Memory released by popped items is kept by the pool and
+ * reused by later reloads instead of being returned to the system allocator.
+**/
+template <class BaseClass>
+struct fq_pool_factory {
+	typedef boost::fast_pool_allocator<BaseClass> allocator_type;
+
+	template <class... Args>
+	boost::shared_ptr<BaseClass> operator()(Args&&... args) const {
+		return boost::allocate_shared<BaseClass>(allocator_type(), std::forward<Args>(args)...);
+	}
+};
+
+/*!
+ * \class FailoverQueue
+ * \brief A thread-safe queue-like container that will spill-over into files on disk.
+ *
+ * This project provides a thread-safe queue-like container that has the ability
+ * to spill queue content into failover files for later reprocessing. This
+ * allows the queus to be fixed sizes (queue length) that periodically write
+ * overflow items into files that can be read back and inserted into the queue
+ * when the queue has fewer items.
+ *
+ * \section Configuration
+ * The following define macros can be used to change the behavior of the class
+ * if they are defined before the header file is included.
+ * \li FQ_FILENAME()
+ * \li FQ_EXT()
+ * \li FQ_OARCHIVE
+ * \li FQ_IARCHIVE
+ * \li FQ_MIN_SIZE(N)
+ * \li FQ_DUMP_SIZE(N)
+ * \li FQ_MIN_BYTES(N)
+ * \li FQ_DUMP_BYTES(N)
+ * \li FQ_FIELD_ALIGN
+ * \li FQ_SPIN_LIMIT
+ * \li FQ_SPIN_ALWAYS
+ * \li FQ_PRODUCER_BATCH
+ * \li FQ_PRODUCER_DEADLINE
+ * \li FQ_HISTOGRAMS
+ * \li FQ_HISTOGRAM_STRIPES
+ * \li FQ_LOCK_PROFILING
+ * \li FQ_TRACE
+ * \li FQ_TRACE_EVENTS
+ * \li FQ_TRACE_LOCK_WAIT
+ * \li FQ_COUNT_NOTIFIES
+ * \li FQ_COROUTINES
+ * \li FQ_EVENTFD
+ * \li FQ_LOG_LEVEL
+ *
+ * \section Budgets
+ * By default the queue spills when it holds more than maxSize items. With
+ * byteBudget() it also spills when the bytes held in memory, as reported by
+ * fq_size_estimator, would exceed the budget. Such spills write the oldest
+ * items until FQ_DUMP_BYTES(N) bytes have been moved to disk, and failover
+ * files are read back once FQ_MIN_BYTES(N) or fewer bytes remain in memory.
+ *
+ * \section Waiting
+ * popw() blocks on a condition variable when the queue is empty. With
+ * waitStrategy() a queue can instead spin until an item arrives, or spin for
+ * a while before blocking. The adaptive strategy doubles its spin budget, up
+ * to FQ_SPIN_LIMIT iterations, each time an item arrives while spinning and
+ * halves it each time the spin runs out. On a single processor machine a
+ * spinning consumer would only delay the producer, so popw() always blocks
+ * unless FQ_SPIN_ALWAYS is set.
+ *
+ * \section Backpressure
+ * By default push() always accepts items and the queue spills once it holds
+ * more than maxSize items, the hard limit. With overflowPolicy() producers
+ * pushing into a queue that holds softLimit or more items wait up to a
+ * timeout for consumers to make room instead. When the timeout passes the
+ * fq_overflow_block policy accepts the item, spilling if the hard limit has
+ * been reached, and fq_overflow_reject makes push() return false. The soft
+ * limit is kept between 1 and maxSize, and counts items only; the byte
+ * budget still spills as before.
+ *
+ * \section Producers
+ * Each push() takes the queue lock. A thread pushing many small items can
+ * instead use a handle from producer(), which buffers items and adds them
+ * to the queue under one lock acquisition when the buffer is full, when a
+ * push finds the oldest buffered item older than the deadline, on flush()
+ * and when the handle is destroyed. A handle belongs to one thread and keeps
+ * the order of its items; items from different handles interleave by batch.
+ *
+ * \section Statistics
+ * stats() returns a snapshot of counters for pushed and popped items,
+ * failover files written and read back with their items, bytes and time,
+ * and files skipped because they were missing or could not be read. The
+ * counters are relaxed atomics kept on their own cache line, so reading
+ * them never takes the queue lock. A failover file that fails to load is
+ * removed and counted instead of aborting the pop.
+ *
+ * \section Ages
+ * Every pushed item is stamped with a coarse wall clock time, and the
+ * stamps are written into failover files alongside the items, so an item
+ * keeps its push time through spills, reloads and restarts. The time from
+ * push to pop is summed into the queuedNanos counter and recorded in the
+ * fq_latency_in_queue histogram, and ages() returns the age of the oldest
+ * item in memory and in failover files. The stamps come from the coarse
+ * real time clock, so ages are only accurate to a few milliseconds.
+ * Failover files written before stamps were added still load; their items
+ * are taken to be as old as the file.
+ *
+ * \section Histograms
+ * Built with FQ_HISTOGRAMS set to 1, the queue records log-linear latency
+ * histograms, in nanoseconds, of pushes, popw() calls, spills, reloads and
+ * the time items spend queued from push to pop, including any time spent in
+ * failover files. latency() merges the per-thread stripes
+ * of one histogram into a snapshot that answers percentile queries, and
+ * can empty the histogram as it reads it. Recording costs two clock reads
+ * per push and pop; without FQ_HISTOGRAMS none of it is compiled in and
+ * latency() returns empty snapshots.
+ *
+ * \section Contention
+ * Built with FQ_LOCK_PROFILING set to 1, every acquisition of the queue
+ * lock records how long the thread waited for it and how long it was then
+ * held, by call site: pushes, pops, and observers such as size() and
+ * empty(). A hold that writes or reads back a failover file is charged to
+ * the spill or reload site instead. lockWait() and lockHold() return the
+ * histograms; without FQ_LOCK_PROFILING the lock is a plain scoped lock.
+ *
+ * \section Tracing
+ * Built with FQ_TRACE set to 1, queues record trace events into one process
+ * wide ring of FQ_TRACE_EVENTS entries: spans for each spill and reload and
+ * for consumers and producers blocked on a condition variable, and lock
+ * waits of at least FQ_TRACE_LOCK_WAIT nanoseconds. fq_trace_dump() writes
+ * the ring as Chrome trace JSON, which chrome://tracing and Perfetto show as
+ * a timeline per thread. Recording an event costs a clock read, an atomic
+ * increment and a few relaxed stores; without FQ_TRACE nothing is recorded
+ * and fq_trace_dump() writes an empty trace.
+ *
+ * \section Logging
+ * The queue logs failover files it writes, reads back or skips through
+ * FQ_LOG(). Nothing is logged unless FQ_LOG_LEVEL is raised above 0 and a
+ * logger is installed with fq_set_logger(); by default every FQ_LOG() call
+ * compiles to nothing, and the queue never writes to stdout itself.
+ * Messages are formatted and sent while the queue lock is held, so loggers
+ * should be quick.
+ *
+ * \section Readiness
+ * On Linux, readyFd() returns an eventfd that is readable while the queue
+ * holds items in memory or has failover files to read back. An event loop
+ * can watch the descriptors of many queues with epoll or poll and drain
+ * the ready ones with the batch try_pop(). The descriptor is level
+ * triggered in effect: it stays readable until a pop leaves the queue and
+ * its failover files empty, and it must not be read by the caller.
+ *
+ * \section Coroutines
+ * When built as C++20, co_await queue.async_pop() suspends the calling
+ * coroutine instead of blocking its thread while the queue and its failover
+ * files are empty. A later push hands its item straight to the oldest
+ * suspended coroutine and resumes it. co_await queue.async_push(item) adds
+ * an item, spilling as push() does before it completes. Under the
+ * fq_overflow_block policy it suspends until a pop makes room instead of
+ * blocking, without a timeout. Under fq_overflow_reject it completes with
+ * false at once.
+ *
+ * Coroutines are resumed on the thread that pushed or popped, unless a
+ * hook set with resumeHook() passes them to an executor. The hook must be
+ * set before coroutines start waiting. clear() resumes suspended pops with
+ * a default constructed item and suspended pushes with false.
+ *
+ * \section Allocation
+ * Items read back from failover files and items passed to emplace() are
+ * created by the Factory template parameter, a functor taking BaseClass
+ * constructor arguments and returning a BaseClassPointer. The default is fq_default_factory; fq_pool_factory can be
+ * used to allocate reloaded items from a pool.
+ *
+ * \section Storage
+ * When BaseClassPointer is the same type as BaseClass, for example
+ * FailoverQueue<Counter, Counter>, items are stored by value in the in-memory
+ * queue and moved in and out of it by push() and popw(). Spilled items are
+ * serialized in place without being copied.
+ *
+ * The in-memory queue is an fq_block_queue of FQ_BLOCK_SIZE items per block.
+ * Blocks freed by pops and spills are kept for reuse, so a queue cycling
+ * between spills and reloads stops allocating once its blocks are in place.
+ *
+ * Move-only pointer types such as std::unique_ptr are supported. Items pushed
+ * as rvalues, spilled, reloaded and popped are moved at every step and the
+ * BaseClass objects themselves are never copied.
+ *
+ * Members are grouped by who writes them: read-mostly configuration, the
+ * mutex with the state it protects, the push sequence polled by spinning
+ * consumers, and each condition variable with its waiter count. Every group
+ * after the first starts on its own cache line, FQ_CACHE_LINE bytes, so a
+ * spinning consumer or a producer signalling waiters does not contend for
+ * the line holding the lock.
+ *
+ * Failover files are written with FQ_OARCHIVE and read with FQ_IARCHIVE,
+ * text archives by default. Defining both as the binary archives gives
+ * smaller files that are faster to write and read, but they can only be read
+ * back on a machine with the same type sizes and byte order.
+ * 
+ *  \author Nick Gerakines <ngerakines@blizzard.com>
+ *  \version 0.2.0
+**/
+template <class BaseClass, class BaseClassPointer, class Factory = fq_default_factory<BaseClass, BaseClassPointer> >
+class FailoverQueue {
+	private:
+		// Read-mostly configuration, written only by the setters and clear().
+		int maxSize_;
+		double minCount_;
+		std::size_t maxBytes_;
+		double minBytes_;
+		fq_wait_strategy waitStrategy_;
+		fq_overflow_policy overflowPolicy_;
+		int softLimit_;
+		long overflowTimeout_;
+
+		std::string failOverPath_;
+		std::string failOverPrefix_;
+
+		Factory factory_;
+
+		/*! \brief A failover file, its id, size on disk, the number of items it holds and the push time of its oldest item.
+		 *  \private
+		**/
+		struct fq_file {
+			std::string name;
+			long id;
+			std::size_t bytes;
+			long items;
+			unsigned long long stamp;
+		};
+
+		// The lock and the state it protects, written by producers and consumers alike.
+		FQ_FIELD_ALIGN mutable fq_mutex mutex_;
+		fq_block_queue<BaseClassPointer> theQueue_;
+		// Push times of the items in theQueue_, kept in step with it.
+		fq_block_queue<unsigned long long> stamps_;
+		// Estimated sizes of the items in theQueue_ when they entered it, 0 without a byte budget.
+		fq_block_queue<std::size_t> sizes_;
+		int itemCount_;
+		std::size_t residentBytes_;
+		std::size_t diskBytes_;
+		long diskItems_;
+		int maxBucket_;
+		int spinBudget_;
+
+		// New files are added at the front and files are read back from the back.
+		std::deque<fq_file> failOverFiles_;
+		int failOverCount_;
+		long failOverId_;
+
+		// Polled without the lock by spinning consumers.
+		FQ_FIELD_ALIGN std::atomic<unsigned long> pushSequence_;
+
+		// Consumers blocked in popw().
+		FQ_FIELD_ALIGN boost::condition_variable condition_;
+		int waiters_;
+#if FQ_COUNT_NOTIFIES
+		std::atomic<unsigned long> notifies_;
+#endif
+
+		// Producers held back by the overflow policy.
+		FQ_FIELD_ALIGN boost::condition_variable spaceCondition_;
+		int blockedProducers_;
+
+		/*! \brief The counters behind stats(), written with the lock held and read without it.
+		 *  \private
+		**/
+		struct fq_counters {
+			std::atomic<unsigned long> pushed;
+			std::atomic<unsigned long> popped;
+			std::atomic<unsigned long> spills;
+			std::atomic<unsigned long> itemsSpilled;
+			std::atomic<unsigned long long> bytesSpilled;
+			std::atomic<unsigned long long> spillNanos;
+			std::atomic<unsigned long> reloads;
+			std::atomic<unsigned long> itemsReloaded;
+			std::atomic<unsigned long long> bytesReloaded;
+			std::atomic<unsigned long long> reloadNanos;
+			std::atomic<unsigned long> missingFiles;
+			std::atomic<unsigned long> corruptFiles;
+			std::atomic<unsigned long long> queuedNanos;
+
+			fq_counters() : pushed(0), popped(0), spills(0), itemsSpilled(0), bytesSpilled(0), spillNanos(0), reloads(0), itemsReloaded(0), bytesReloaded(0), reloadNanos(0), missingFiles(0), corruptFiles(0), queuedNanos(0) { }
+		};
+
+		FQ_FIELD_ALIGN fq_counters counters_;
+
+#if FQ_HISTOGRAMS
+		fq_histogram histograms_[fq_latency_count];
+#endif
+
+	public:
+		//! Construct a failover queue object with a given path and max size.
+		/*! \param path The directory that failover files are saved in.
+		 *  \param maxSize The queue item size that must be reached before items are dumped into failover files.
+		 *  \param factory The functor used to create items read back from failover files.
+		**/
+		FailoverQueue(std::string path, int maxSize, Factory factory = Factory()) : FailoverQueue(path, FQ_FILENAME, maxSize, factory) { }
+
+		//! Construct a failover queue object whose failover files use the given file name prefix.
+		/*! Only files named with the prefix followed by a number are
+		 *  picked up, so queues with different prefixes can share a
+		 *  directory.
+		 *  \param path The directory that failover files are saved in.
+		 *  \param prefix The prefix used when creating and reading failover files.
+		 *  \param maxSize The queue item size that must be reached before items are dumped into failover files.
+		 *  \param factory The functor used to create items read back from failover files.
+		**/
+		FailoverQueue(std::string path, std::string prefix, int maxSize, Factory factory = Factory()) : maxSize_(maxSize), maxBytes_(0), minBytes_(0), waitStrategy_(fq_wait_block), overflowPolicy_(fq_overflow_spill), softLimit_(0), overflowTimeout_(0), failOverPath_(path), failOverPrefix_(prefix), factory_(factory), itemCount_(0), residentBytes_(0), diskBytes_(0), diskItems_(0), maxBucket_(0), spinBudget_(FQ_SPIN_LIMIT / 8), failOverCount_(0), failOverId_(0), pushSequence_(0), waiters_(0), blockedProducers_(0) {
+			minCount_ = FQ_MIN_SIZE(maxSize_);
+#if FQ_COROUTINES
+			popHead_ = popTail_ = 0;
+			pushHead_ = pushTail_ = 0;
+#endif
+#if FQ_EVENTFD
+			readyFd_ = -1;
+			readySignalled_ = false;
+#endif
+#if FQ_COUNT_NOTIFIES
+			notifies_.store(0);
+#endif
+
+			bootstrap();
+		}
+
+		//! The deconstructor
+		~FailoverQueue() {
+			condition_.notify_all();
+			spaceCondition_.notify_all();
+#if FQ_EVENTFD
+			if (readyFd_ >= 0) {
+				close(readyFd_);
+			}
+#endif
+		}
+
+		//! Returns true if the internal queue is empty.
+		/*! It is important to note that this does not account for the
+		 *  the existance or item count of failover files. It is
+		 *  important to note that if the FQ_MIN_SIZE(N) macro is set to
+		 *  return 0, a race condition could occur where this method
+		 *  return true while a failover file is being read.
+		**/
+		bool empty() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			return itemCount_ == 0;
+		}
+
+		//! Returns the size of the internal queue.
+		/*! This method does not take into account the number of or size
+		 *  of any failoever files managed by this object.
+		**/
+		int size() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			return itemCount_;
+		}
+
+		//! Returns the estimated number of bytes held by the internal queue.
+		/*! Sizes are only estimated while a byte budget is set, so this
+		 *  is 0 without one.
+		**/
+		std::size_t residentBytes() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			return residentBytes_;
+		}
+
+		//! Returns the number of bytes held in failover files.
+		std::size_t diskBytes() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			return diskBytes_;
+		}
+
+		//! Returns a snapshot of the queue counters without taking the queue lock.
+		fq_stats stats() const {
+			fq_stats stats;
+			stats.pushed = counters_.pushed.load(std::memory_order_relaxed);
+			stats.popped = counters_.popped.load(std::memory_order_relaxed);
+			stats.spills = counters_.spills.load(std::memory_order_relaxed);
+			stats.itemsSpilled = counters_.itemsSpilled.load(std::memory_order_relaxed);
+			stats.bytesSpilled = counters_.bytesSpilled.load(std::memory_order_relaxed);
+			stats.spillNanos = counters_.spillNanos.load(std::memory_order_relaxed);
+			stats.reloads = counters_.reloads.load(std::memory_order_relaxed);
+			stats.itemsReloaded = counters_.itemsReloaded.load(std::memory_order_relaxed);
+			stats.bytesReloaded = counters_.bytesReloaded.load(std::memory_order_relaxed);
+			stats.reloadNanos = counters_.reloadNanos.load(std::memory_order_relaxed);
+			stats.missingFiles = counters_.missingFiles.load(std::memory_order_relaxed);
+			stats.corruptFiles = counters_.corruptFiles.load(std::memory_order_relaxed);
+			stats.queuedNanos = counters_.queuedNanos.load(std::memory_order_relaxed);
+			return stats;
+		}
+
+		//! Returns the ages of the oldest items in memory and in failover files.
+		/*! Files found when the queue was constructed, or written without
+		 *  push times, are taken to be as old as their modification time,
+		 *  which their items are at least as old as.
+		**/
+		fq_ages ages() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			unsigned long long now = fq_stamp_nanos();
+			fq_ages ages = { 0, 0 };
+			if (!stamps_.empty()) {
+				ages.memory = fq_stamp_age(stamps_.front(), now);
+			}
+			for (std::size_t i = 0; i < failOverFiles_.size(); i++) {
+				ages.disk = std::max(ages.disk, fq_stamp_age(failOverFiles_[i].stamp, now));
+			}
+			return ages;
+		}
+
+		//! Returns a snapshot of one latency histogram, in nanoseconds.
+		/*! \param which The operation to return the histogram of.
+		 *  \param reset Set to true to empty the histogram as it is read.
+		 *  \return An empty snapshot unless FQ_HISTOGRAMS is set.
+		**/
+		fq_histogram_snapshot latency(fq_latency which, bool reset = false) {
+#if FQ_HISTOGRAMS
+			return histograms_[which].snapshot(reset);
+#else
+			(void) which;
+			(void) reset;
+			return fq_histogram_snapshot();
+#endif
+		}
+
+		//! Returns a snapshot of the time spent waiting for the queue lock at a site, in nanoseconds.
+		/*! \param site The call site to return the histogram of.
+		 *  \param reset Set to true to empty the histogram as it is read.
+		 *  \return An empty snapshot unless FQ_LOCK_PROFILING is set.
+		**/
+		fq_histogram_snapshot lockWait(fq_lock_site site, bool reset = false) {
+#if FQ_LOCK_PROFILING
+			return mutex_.waits(site).snapshot(reset);
+#else
+			(void) site;
+			(void) reset;
+			return fq_histogram_snapshot();
+#endif
+		}
+
+		//! Returns a snapshot of how long the queue lock was held at a site, in nanoseconds.
+		/*! Holds that wrote or read back a failover file are charged to
+		 *  fq_lock_spill or fq_lock_reload rather than to the site that
+		 *  took the lock.
+		 *  \param site The call site to return the histogram of.
+		 *  \param reset Set to true to empty the histogram as it is read.
+		 *  \return An empty snapshot unless FQ_LOCK_PROFILING is set.
+		**/
+		fq_histogram_snapshot lockHold(fq_lock_site site, bool reset = false) {
+#if FQ_LOCK_PROFILING
+			return mutex_.holds(site).snapshot(reset);
+#else
+			(void) site;
+			(void) reset;
+			return fq_histogram_snapshot();
+#endif
+		}
+
+		//! Returns the number of items waiting in memory and in failover files.
+		/*! Files found when the queue was constructed are counted as
+		 *  FQ_DUMP_SIZE(maxSize) items each until they are read back.
+		**/
+		long backlog() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			return itemCount_ + diskItems_;
+		}
+
+		//! Sets the number of bytes the internal queue may hold before items are dumped into failover files.
+		/*! Item sizes are estimated with fq_size_estimator when items
+		 *  enter the internal queue, and that estimate is what they count
+		 *  for until they leave it. Items already queued are estimated
+		 *  again here. A budget of 0 disables byte based spilling and
+		 *  size estimates.
+		**/
+		void byteBudget(std::size_t maxBytes) {
+			fq_lock lock(mutex_, fq_lock_observer);
+			maxBytes_ = maxBytes;
+			minBytes_ = FQ_MIN_BYTES(maxBytes_);
+			residentBytes_ = 0;
+			typename fq_block_queue<std::size_t>::iterator size = sizes_.begin();
+			typename fq_block_queue<BaseClassPointer>::iterator end = theQueue_.end();
+			for (typename fq_block_queue<BaseClassPointer>::iterator it = theQueue_.begin(); it != end; ++it, ++size) {
+				*size = itemBytes(*it);
+				residentBytes_ += *size;
+			}
+		}
+
+		//! Returns the number of signals sent to consumers blocked in popw().
+		/*! \return 0 unless FQ_COUNT_NOTIFIES is set.
+		**/
+		unsigned long notifies() const {
+#if FQ_COUNT_NOTIFIES
+			return notifies_.load(std::memory_order_relaxed);
+#else
+			return 0;
+#endif
+		}
+
+		//! Returns the number of iterations the adaptive wait strategy spins for before blocking.
+		int spinBudget() const {
+			fq_lock lock(mutex_, fq_lock_observer);
+			return spinBudget_;
+		}
+
+		//! Sets how popw() waits when the queue is empty.
+		void waitStrategy(fq_wait_strategy strategy) {
+			fq_lock lock(mutex_, fq_lock_observer);
+			waitStrategy_ = strategy;
+		}
+
+		//! Sets what push() does when the queue holds softLimit or more items.
+		/*! \param policy fq_overflow_spill to always accept items, or
+		 *  fq_overflow_block or fq_overflow_reject to hold producers back.
+		 *  \param softLimit The item count at which producers are held back,
+		 *  from 1 to maxSize. 0, the default, and larger values hold them back at maxSize.
+		 *  \param timeout The number of milliseconds a producer waits for room before the item is accepted or rejected.
+		 *  With 0, the default, producers do not wait: fq_overflow_block accepts the
+		 *  item at once, spilling if the hard limit has been reached, and
+		 *  fq_overflow_reject rejects it at once.
+		**/
+		void overflowPolicy(fq_overflow_policy policy, int softLimit = 0, long timeout = 0) {
+			fq_lock lock(mutex_, fq_lock_observer);
+			overflowPolicy_ = policy;
+			if (softLimit <= 0 || softLimit > maxSize_) {
+				softLimit = maxSize_;
+			}
+			softLimit_ = std::max(softLimit, 1);
+			overflowTimeout_ = std::max(timeout, 0L);
+			spaceCondition_.notify_all();
+		}
+
+		//! Adds an item to the queue.
+		bool push(const BaseClassPointer &item) {
+			return enqueue(item);
+		}
+
+		//! Adds an item to the queue, moving it into place.
+		bool push(BaseClassPointer &&item) {
+			return enqueue(std::move(item));
+		}
+
+		//! Constructs an item with the factory and adds it to the queue.
+		/*! The item is constructed before the queue is locked.
+		**/
+		template <class... Args>
+		bool emplace(Args&&... args) {
+			return enqueue(factory_(std::forward<Args>(args)...));
+		}
+
+		/*!
+		 * \class Producer
+		 * \brief A per-thread handle that adds buffered items to the queue in batches.
+		 *
+		 * A Producer must only be used by one thread at a time and must not
+		 * outlive its queue. Items still buffered when it is destroyed are
+		 * flushed. If the overflow policy rejects items they stay buffered,
+		 * in order, until a later flush succeeds.
+		**/
+		class Producer {
+			private:
+				FailoverQueue *queue_;
+				std::vector<BaseClassPointer> buffer_;
+				std::size_t batch_;
+				std::chrono::microseconds deadline_;
+				std::chrono::steady_clock::time_point oldest_;
+
+			public:
+				Producer(FailoverQueue *queue, std::size_t batch, long deadline) : queue_(queue), batch_(batch > 0 ? batch : 1), deadline_(deadline) {
+					buffer_.reserve(batch_);
+				}
+
+				Producer(Producer &&other) : queue_(other.queue_), buffer_(std::move(other.buffer_)), batch_(other.batch_), deadline_(other.deadline_), oldest_(other.oldest_) {
+					other.queue_ = 0;
+				}
+
+				~Producer() {
+					if (queue_) {
+						flush();
+					}
+				}
+
+				//! Returns the number of buffered items.
+				std::size_t size() const { return buffer_.size(); }
+
+				//! Buffers an item, flushing the buffer if it is full or its oldest item is past the deadline.
+				/*! \return false if a flush was needed and the overflow policy rejected items.
+				**/
+				bool push(const BaseClassPointer &item) {
+					return add(item);
+				}
+
+				//! Buffers an item by moving it, flushing as push() does.
+				bool push(BaseClassPointer &&item) {
+					return add(std::move(item));
+				}
+
+				//! Constructs an item with the queue factory and buffers it.
+				template <class... Args>
+				bool emplace(Args&&... args) {
+					return add(queue_->factory_(std::forward<Args>(args)...));
+				}
+
+				//! Adds all buffered items to the queue.
+				/*! \return false if the overflow policy rejected items, which stay buffered.
+				**/
+				bool flush() {
+					if (buffer_.empty()) {
+						return true;
+					}
+					std::size_t accepted = queue_->enqueueBatch(buffer_);
+					buffer_.erase(buffer_.begin(), buffer_.begin() + accepted);
+					oldest_ = std::chrono::steady_clock::now();
+					return buffer_.empty();
+				}
+
+			private:
+				template <class Item>
+				bool add(Item &&item) {
+					if (buffer_.empty()) {
+						oldest_ = std::chrono::steady_clock::now();
+					}
+					buffer_.push_back(std::forward<Item>(item));
+					if (buffer_.size() >= batch_ || std::chrono::steady_clock::now() - oldest_ >= deadline_) {
+						return flush();
+					}
+					return true;
+				}
+
+				Producer(const Producer &);
+				Producer &operator=(const Producer &);
+		};
+
+		//! Returns a handle that buffers items pushed by one thread and adds them in batches.
+		/*! \param batch The number of items buffered before they are flushed.
+		 *  \param deadline The number of microseconds items may stay buffered before a push flushes them.
+		**/
+		Producer producer(std::size_t batch = FQ_PRODUCER_BATCH, long deadline = FQ_PRODUCER_DEADLINE) {
+			return Producer(this, batch, deadline);
+		}
+
+#if FQ_COROUTINES
+		/*!
+		 * \class PopAwaiter
+		 * \brief The awaitable returned by async_pop().
+		**/
+		class PopAwaiter {
+			private:
+				friend class FailoverQueue;
+				FailoverQueue *queue_;
+				BaseClassPointer item_;
+				std::coroutine_handle<> handle_;
+				PopAwaiter *next_;
+
+			public:
+				explicit PopAwaiter(FailoverQueue *queue) : queue_(queue), item_(), next_(0) { }
+
+				bool await_ready() { return queue_->try_pop(item_); }
+
+				bool await_suspend(std::coroutine_handle<> handle) {
+					handle_ = handle;
+					return queue_->suspendPop(this);
+				}
+
+				BaseClassPointer await_resume() { return std::move(item_); }
+		};
+
+		/*!
+		 * \class PushAwaiter
+		 * \brief The awaitable returned by async_push().
+		**/
+		class PushAwaiter {
+			private:
+				friend class FailoverQueue;
+				FailoverQueue *queue_;
+				BaseClassPointer item_;
+				bool result_;
+				std::coroutine_handle<> handle_;
+				PushAwaiter *next_;
 
-		int maxBucket_;
-		mutable boost::mutex mutex_;
-		boost::condition_variable condition_;
-		int itemCount_;
+			public:
+				template <class Item>
+				PushAwaiter(FailoverQueue *queue, Item &&item) : queue_(queue), item_(std::forward<Item>(item)), result_(false), next_(0) { }
 
-		int maxSize_;
+				bool await_ready() { return false; }
 
-		std::vector<std::string> failOverFiles_;
-		int failOverCount_;
-		double minCount_;
+				bool await_suspend(std::coroutine_handle<> handle) {
+					handle_ = handle;
+					return queue_->suspendPush(this);
+				}
 
-		std::string failOverPath_;
+				bool await_resume() { return result_; }
+		};
 
-	public:
-		//! Construct a failover queue object with a given path and max size.
-		/*! \param path The directory that failover files are saved in.
-		 *  \param maxSize The queue item size that must be reached before items are dumped into failover files.
-		**/
-		FailoverQueue(std::string path, int maxSize) : maxBucket_(0), itemCount_(0), maxSize_(maxSize), failOverCount_(0), failOverPath_(path) {
-			minCount_ = FQ_MIN_SIZE(maxSize_);
+		//! Returns an awaitable that pops an item, suspending the coroutine until one is available.
+		PopAwaiter async_pop() {
+			return PopAwaiter(this);
+		}
 
-			bootstrap();
+		//! Returns an awaitable that adds an item and completes once any spill it caused is written.
+		/*! \return From co_await, false if the overflow policy rejected the item.
+		**/
+		PushAwaiter async_push(const BaseClassPointer &item) {
+			return PushAwaiter(this, item);
 		}
 
-		//! The deconstructor
-		~FailoverQueue() {
-			condition_.notify_all();
+		//! Returns an awaitable that adds an item by moving it.
+		PushAwaiter async_push(BaseClassPointer &&item) {
+			return PushAwaiter(this, std::move(item));
 		}
 
-		//! Returns true if the internal queue is empty.
-		/*! It is important to note that this does not account for the
-		 *  the existance or item count of failover files. It is
-		 *  important to note that if the FQ_MIN_SIZE(N) macro is set to
-		 *  return 0, a race condition could occur where this method
-		 *  return true while a failover file is being read.
+		//! Sets the function that resumes coroutines waiting in async_pop() and async_push().
+		/*! The hook is called without the queue lock held, on the thread
+		 *  that made the item or the room available. An empty hook resumes
+		 *  coroutines inline.
 		**/
-		bool empty() {
-			boost::mutex::scoped_lock lock(mutex_);
-			return itemCount_ == 0;
+		void resumeHook(std::function<void(std::coroutine_handle<>)> hook) {
+			fq_lock lock(mutex_, fq_lock_observer);
+			resumeHook_ = hook;
 		}
+#endif
 
-		//! Returns the size of the internal queue.
-		/*! This method does not take into account the number of or size
-		 *  of any failoever files managed by this object.
+		//! Pops an item from the queue, waiting until one is available if necessary.
+		/*! This is a blocking operation. A consumer released by clear()
+		 *  receives a default constructed BaseClassPointer.
 		**/
-		int size() {
-			boost::mutex::scoped_lock lock(mutex_);
-			return itemCount_;
+		BaseClassPointer popw() {
+			unsigned long long start = latencyStart();
+			fq_lock lock(mutex_, fq_lock_pop);
+
+			while (!fill());
+
+			if (waitStrategy_ != fq_wait_block && fq_spin_useful() && theQueue_.empty() && maxSize_ != -1 && failOverCount_ < 1) {
+				spin(lock);
+			}
+
+			while (theQueue_.empty() && maxSize_ != -1 && failOverCount_ < 1) {
+				fq_trace_scope blocked("consumer blocked");
+				++waiters_;
+				lock.wait(condition_);
+				--waiters_;
+			}
+
+			recordSince(fq_latency_popw, start);
+			if (theQueue_.empty()) {
+				return BaseClassPointer();
+			}
+			BaseClassPointer item = take();
+			release(lock);
+			return item;
 		}
 
-		//! Adds an item to the queue.
-		bool push(BaseClassPointer item) {
-			boost::mutex::scoped_lock lock(mutex_);
-			if (itemCount_ > maxSize_) {
-				std::string fileName = failOverFile();
-				std::ofstream ofs(fileName.c_str());
-				boost::archive::text_oarchive oa(ofs);
-				int c = FQ_DUMP_SIZE(maxSize_);
-				fq_container container;
-				while (c > 0) {
-					BaseClassPointer tmpItem = theQueue_.front();
-					container.add(*tmpItem.get());
-					theQueue_.pop();
-					--itemCount_;
-					--c;
-				}
-				oa << container;
+		//! Pops an item from the queue if one is available.
+		/*! Failover files are read back as needed, but the call never
+		 *  waits for new items to be pushed.
+		 *  \param item Set to the popped item.
+		 *  \return true if an item was popped.
+		**/
+		bool try_pop(BaseClassPointer &item) {
+			fq_lock lock(mutex_, fq_lock_pop);
+
+			while (!fill());
+
+			if (theQueue_.empty()) {
+				return false;
 			}
-			theQueue_.push(item);
-			++itemCount_;
-			condition_.notify_one();
+			item = take();
+			release(lock);
 			return true;
 		}
 
-		//! Pops an item from the queue, waiting until one is available if necessary.
-		/*! This is a blocking operation.
+		//! Pops up to max items from the queue under one lock acquisition.
+		/*! Failover files are read back as needed, but the call never
+		 *  waits for new items to be pushed.
+		 *  \param items The popped items are appended to this vector.
+		 *  \param max The largest number of items to pop.
+		 *  \return The number of items popped.
 		**/
-		BaseClassPointer popw() {
-			boost::mutex::scoped_lock lock(mutex_);
+		std::size_t try_pop(std::vector<BaseClassPointer> &items, std::size_t max) {
+			fq_lock lock(mutex_, fq_lock_pop);
+			return takeBatch(lock, items, max);
+		}
+
+		//! Pops up to max items, waiting up to a timeout for the first one.
+		/*! \param items The popped items are appended to this vector.
+		 *  \param max The largest number of items to pop.
+		 *  \param timeout The number of milliseconds to wait for an item.
+		 *  \return The number of items popped, 0 if the timeout passed or the queue was cleared.
+		**/
+		std::size_t popw(std::vector<BaseClassPointer> &items, std::size_t max, long timeout) {
+			unsigned long long start = latencyStart();
+			fq_lock lock(mutex_, fq_lock_pop);
 
 			while (!fill());
 
+			boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout);
 			while (theQueue_.empty() && maxSize_ != -1 && failOverCount_ < 1) {
-				condition_.wait(lock);
+				fq_trace_scope blocked("consumer blocked");
+				++waiters_;
+				bool signalled = lock.timed_wait(condition_, deadline);
+				--waiters_;
+				if (!signalled) {
+					break;
+				}
 			}
 
-			BaseClassPointer item = theQueue_.front();
-			theQueue_.pop();
-			--itemCount_;
-			return item;
+			recordSince(fq_latency_popw, start);
+			return takeBatch(lock, items, max);
+		}
+
+#if FQ_EVENTFD
+		//! Returns an eventfd that is readable while items can be popped.
+		/*! The descriptor is created on the first call, is owned by the
+		 *  queue and is closed when the queue is destroyed. Callers wait
+		 *  for it to become readable but never read it themselves.
+		 *  \return The descriptor, or -1 if it could not be created.
+		**/
+		int readyFd() {
+			fq_lock lock(mutex_, fq_lock_observer);
+			if (readyFd_ < 0) {
+				readyFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				readySignalled_ = false;
+				updateReady();
+			}
+			return readyFd_;
 		}
+#endif
 
 		//! Empties the internal queue and optionally deletes all of the failover files.
 		void clear(bool deleteFiles = true) {
-			boost::mutex::scoped_lock lock(mutex_);
+			fq_lock lock(mutex_, fq_lock_observer);
 			itemCount_ = 0;
-			while (!theQueue_.empty()) {
-				theQueue_.pop();
-			}
+			residentBytes_ = 0;
+			theQueue_.clear();
+			stamps_.clear();
+			sizes_.clear();
 			maxSize_ = -1;
+			bumpSequence();
+			spaceCondition_.notify_all();
 			if (deleteFiles) {
 				for (int i = 0; i < (int) failOverFiles_.size(); i++) {
-					std::string fileName = failOverFiles_[i];
+					std::string fileName = failOverFiles_[i].name;
 				}
 			}
 			// NKG: Should this be notify_all if there are more than one blocked requestors of popw()?
-			condition_.notify_one();
+			notifyOne();
+#if FQ_COROUTINES
+			PopAwaiter *pops = popHead_;
+			PushAwaiter *pushes = pushHead_;
+			popHead_ = popTail_ = 0;
+			pushHead_ = pushTail_ = 0;
+			lock.unlock();
+			resumeAll(pops);
+			resumeAll(pushes);
+#endif
 		}
 
 		//! Returns the known failover files.
-		std::vector<std::string> failOverFiles() { return failOverFiles_; }
+		std::vector<std::string> failOverFiles() {
+			std::vector<std::string> files;
+			for (int i = 0; i < (int) failOverFiles_.size(); i++) {
+				files.push_back(failOverFiles_[i].name);
+			}
+			return files;
+		}
 
 	private:
 
-		/*! \brief A private utility class used to create variable-length failover files.
+		/*! \brief Add an item to the queue, spilling the oldest items into a failover file if it is full.
 		 *  \private
 		**/
-		class fq_container {
-			public:
-				std::vector<BaseClass> data;
-				void add(BaseClass item) {
-					data.push_back(item);
+		template <class Item>
+		bool enqueue(Item &&item) {
+			unsigned long long start = latencyStart();
+			fq_lock lock(mutex_, fq_lock_push);
+			if (overflowPolicy_ != fq_overflow_spill && itemCount_ >= softLimit_ && !holdBack(lock)) {
+				return false;
+			}
+			insert(std::forward<Item>(item));
+			bumpSequence();
+#if FQ_COROUTINES
+			PopAwaiter *ready = handOff();
+#endif
+			// Only signal when a consumer is blocked in popw(), and after unlocking so it can take the lock at once.
+			bool wake = waiters_ > 0;
+			lock.unlock();
+			if (wake) {
+				notifyOne();
+			}
+#if FQ_COROUTINES
+			resumeAll(ready);
+#endif
+			recordSince(fq_latency_push, start);
+			return true;
+		}
+
+		/*! \brief Add items to the queue under one lock acquisition, in order.
+		 *  \return The number of items added, fewer than items.size() if the overflow policy rejected one.
+		 *  \private
+		**/
+		std::size_t enqueueBatch(std::vector<BaseClassPointer> &items) {
+			unsigned long long start = latencyStart();
+			fq_lock lock(mutex_, fq_lock_push);
+			std::size_t count = 0;
+#if FQ_COROUTINES
+			PopAwaiter *ready = 0;
+#endif
+			for (; count < items.size(); count++) {
+				if (overflowPolicy_ != fq_overflow_spill && itemCount_ >= softLimit_) {
+					// Let consumers see the items added so far before waiting for them to make room.
+					if (count > 0) {
+						bumpSequence();
+						notifyAll();
+#if FQ_COROUTINES
+						ready = append(ready, handOff());
+#endif
+					}
+					if (!holdBack(lock)) {
+						break;
+					}
 				}
-			private:
-				friend class boost::serialization::access;
-				template<class Archive>
-				void serialize(Archive & ar, const unsigned int /* version */) {
-					ar & data;
+				insert(std::move(items[count]));
+			}
+			bumpSequence();
+#if FQ_COROUTINES
+			ready = append(ready, handOff());
+#endif
+			int wake = waiters_;
+			lock.unlock();
+			if (wake > 1 && count > 1) {
+				notifyAll();
+			} else if (wake > 0) {
+				notifyOne();
+			}
+#if FQ_COROUTINES
+			resumeAll(ready);
+#endif
+			recordSince(fq_latency_push, start);
+			return count;
+		}
+
+		/*! \brief Append an item, spilling the oldest items first if the queue is full. Called with the lock held.
+		 *  \private
+		**/
+		template <class Item>
+		void insert(Item &&item) {
+			std::size_t bytes = itemBytes(item);
+			if (itemCount_ > maxSize_ || (maxBytes_ > 0 && itemCount_ > 0 && residentBytes_ + bytes > maxBytes_)) {
+				spill();
+			}
+			theQueue_.push_back(std::forward<Item>(item));
+			stamps_.push_back(fq_stamp_nanos());
+			sizes_.push_back(bytes);
+			++itemCount_;
+			residentBytes_ += bytes;
+			fq_count(counters_.pushed, 1);
+		}
+
+		/*! \brief Wait up to the overflow timeout for the queue to drop below the soft limit.
+		 *  \return true if the item may be pushed.
+		 *  \private
+		**/
+		bool holdBack(fq_lock &lock) {
+			if (overflowTimeout_ > 0) {
+				boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(overflowTimeout_);
+				++blockedProducers_;
+				while (overflowPolicy_ != fq_overflow_spill && itemCount_ >= softLimit_ && maxSize_ != -1) {
+					fq_trace_scope blocked("producer blocked");
+					if (!lock.timed_wait(spaceCondition_, deadline)) {
+						break;
+					}
 				}
-		};
+				--blockedProducers_;
+			}
+			return overflowPolicy_ != fq_overflow_reject || itemCount_ < softLimit_ || maxSize_ == -1;
+		}
+
+		/*! \brief Unlock after a pop and wake a producer held back by the soft limit, if there is one.
+		 *  \private
+		**/
+		void release(fq_lock &lock) {
+			bool wake = blockedProducers_ > 0 && itemCount_ < softLimit_;
+			updateReady();
+#if FQ_COROUTINES
+			// Suspended async_push() calls take the room before threads blocked in push().
+			PushAwaiter *admitted = 0;
+			PushAwaiter **last = &admitted;
+			while (pushHead_ && itemCount_ < softLimit_) {
+				PushAwaiter *awaiter = pushHead_;
+				pushHead_ = awaiter->next_;
+				insert(std::move(awaiter->item_));
+				awaiter->result_ = true;
+				awaiter->next_ = 0;
+				*last = awaiter;
+				last = &awaiter->next_;
+			}
+			if (!pushHead_) {
+				pushTail_ = 0;
+			}
+			bool wakeConsumers = false;
+			if (admitted) {
+				bumpSequence();
+				wakeConsumers = waiters_ > 0;
+				wake = wake && itemCount_ < softLimit_;
+			}
+			lock.unlock();
+			if (wakeConsumers) {
+				notifyAll();
+			}
+#else
+			lock.unlock();
+#endif
+			if (wake) {
+				spaceCondition_.notify_one();
+			}
+#if FQ_COROUTINES
+			resumeAll(admitted);
+#endif
+		}
+
+#if FQ_COROUTINES
+		/*! \brief Take an item for a coroutine waiting in async_pop(), or queue the coroutine.
+		 *  \return true if the coroutine was queued and stays suspended.
+		 *  \private
+		**/
+		bool suspendPop(PopAwaiter *awaiter) {
+			fq_lock lock(mutex_, fq_lock_pop);
+			while (!fill());
+			if (!theQueue_.empty() || maxSize_ == -1) {
+				if (!theQueue_.empty()) {
+					awaiter->item_ = take();
+				}
+				release(lock);
+				return false;
+			}
+			if (popTail_) {
+				popTail_->next_ = awaiter;
+			} else {
+				popHead_ = awaiter;
+			}
+			popTail_ = awaiter;
+			return true;
+		}
+
+		/*! \brief Add the item of an async_push(), or queue the coroutine until there is room.
+		 *  \return true if the coroutine was queued and stays suspended.
+		 *  \private
+		**/
+		bool suspendPush(PushAwaiter *awaiter) {
+			fq_lock lock(mutex_, fq_lock_push);
+			if (overflowPolicy_ != fq_overflow_spill && itemCount_ >= softLimit_ && maxSize_ != -1) {
+				if (overflowPolicy_ == fq_overflow_reject) {
+					awaiter->result_ = false;
+					return false;
+				}
+				if (pushTail_) {
+					pushTail_->next_ = awaiter;
+				} else {
+					pushHead_ = awaiter;
+				}
+				pushTail_ = awaiter;
+				return true;
+			}
+			insert(std::move(awaiter->item_));
+			awaiter->result_ = true;
+			bumpSequence();
+			PopAwaiter *ready = handOff();
+			bool wake = waiters_ > 0;
+			lock.unlock();
+			if (wake) {
+				notifyOne();
+			}
+			resumeAll(ready);
+			return false;
+		}
+
+		/*! \brief Give queued items to coroutines waiting in async_pop(). Called with the lock held.
+		 *  \return The coroutines to resume once the lock is released.
+		 *  \private
+		**/
+		PopAwaiter *handOff() {
+			PopAwaiter *ready = 0;
+			PopAwaiter **last = &ready;
+			while (popHead_ && !theQueue_.empty()) {
+				PopAwaiter *awaiter = popHead_;
+				popHead_ = awaiter->next_;
+				awaiter->item_ = take();
+				awaiter->next_ = 0;
+				*last = awaiter;
+				last = &awaiter->next_;
+			}
+			if (!popHead_) {
+				popTail_ = 0;
+			}
+			updateReady();
+			return ready;
+		}
+
+		/*! \brief Join two lists of coroutines to resume.
+		 *  \private
+		**/
+		static PopAwaiter *append(PopAwaiter *first, PopAwaiter *second) {
+			if (!first) {
+				return second;
+			}
+			PopAwaiter *last = first;
+			while (last->next_) {
+				last = last->next_;
+			}
+			last->next_ = second;
+			return first;
+		}
+
+		/*! \brief Resume a list of coroutines through the resume hook. Called without the lock.
+		 *  \private
+		**/
+		template <class Awaiter>
+		void resumeAll(Awaiter *awaiter) {
+			while (awaiter) {
+				// The awaiter lives in the coroutine frame, which may be gone once it has been resumed.
+				Awaiter *next = awaiter->next_;
+				std::coroutine_handle<> handle = awaiter->handle_;
+				if (resumeHook_) {
+					resumeHook_(handle);
+				} else {
+					handle.resume();
+				}
+				awaiter = next;
+			}
+		}
+#endif
+
+		/*! \brief Release the lock and spin until an item is pushed or the spin budget runs out.
+		 *  \private
+		**/
+		void spin(fq_lock &lock) {
+			unsigned long seen = pushSequence_.load(std::memory_order_relaxed);
+			bool forever = waitStrategy_ == fq_wait_spin;
+			int budget = spinBudget_;
+			int i = 0;
+			lock.unlock();
+			for (; forever || i < budget; i++) {
+				if (pushSequence_.load(std::memory_order_acquire) != seen) {
+					break;
+				}
+				// Yield now and then so a spinner cannot starve the producer on a busy or single core machine.
+				if ((i & 63) == 63) {
+					boost::this_thread::yield();
+				} else {
+					fq_cpu_relax();
+				}
+			}
+			lock.lock();
+			if (!forever) {
+				if (i < budget) {
+					spinBudget_ = std::min(spinBudget_ * 2, FQ_SPIN_LIMIT);
+				} else {
+					spinBudget_ = std::max(spinBudget_ / 2, 1);
+				}
+			}
+		}
+
+		/*! \brief Tell spinning consumers and the readiness descriptor that the queue has changed. Called with the lock held.
+		 *  \private
+		**/
+		void bumpSequence() {
+			pushSequence_.store(pushSequence_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			updateReady();
+		}
+
+		/*! \brief Wake one consumer blocked in popw().
+		 *  \private
+		**/
+		void notifyOne() {
+#if FQ_COUNT_NOTIFIES
+			notifies_.fetch_add(1, std::memory_order_relaxed);
+#endif
+			condition_.notify_one();
+		}
+
+		/*! \brief Wake every consumer blocked in popw().
+		 *  \private
+		**/
+		void notifyAll() {
+#if FQ_COUNT_NOTIFIES
+			notifies_.fetch_add(1, std::memory_order_relaxed);
+#endif
+			condition_.notify_all();
+		}
+
+		/*! \brief Make the readiness descriptor readable exactly while items can be popped. Called with the lock held.
+		 *  \private
+		**/
+		void updateReady() {
+#if FQ_EVENTFD
+			if (readyFd_ < 0) {
+				return;
+			}
+			bool ready = !theQueue_.empty() || failOverCount_ > 0;
+			if (ready && !readySignalled_) {
+				eventfd_write(readyFd_, 1);
+				readySignalled_ = true;
+			} else if (!ready && readySignalled_) {
+				eventfd_t value;
+				eventfd_read(readyFd_, &value);
+				readySignalled_ = false;
+			}
+#endif
+		}
+
+		/*! \brief Pop up to max items, reading failover files back as needed, and unlock if any were popped.
+		 *  \private
+		**/
+		std::size_t takeBatch(fq_lock &lock, std::vector<BaseClassPointer> &items, std::size_t max) {
+			std::size_t count = 0;
+			for (; count < max; count++) {
+				while (!fill());
+				if (theQueue_.empty()) {
+					break;
+				}
+				items.push_back(take());
+			}
+			if (count > 0) {
+				release(lock);
+			}
+			return count;
+		}
+
+		/*! \brief The start time of a timed operation, or 0 without FQ_HISTOGRAMS.
+		 *  \private
+		**/
+		static unsigned long long latencyStart() {
+#if FQ_HISTOGRAMS
+			return fq_now_nanos();
+#else
+			return 0;
+#endif
+		}
+
+		/*! \brief Record the time since a latencyStart() in a histogram.
+		 *  \private
+		**/
+		void recordSince(fq_latency which, unsigned long long start) {
+#if FQ_HISTOGRAMS
+			histograms_[which].record(fq_now_nanos() - start);
+#else
+			(void) which;
+			(void) start;
+#endif
+		}
+
+		/*! \brief Record a duration in a histogram.
+		 *  \private
+		**/
+		void recordLatency(fq_latency which, unsigned long long nanos) {
+#if FQ_HISTOGRAMS
+			histograms_[which].record(nanos);
+#else
+			(void) which;
+			(void) nanos;
+#endif
+		}
+
+		/*! \brief Charge the current hold of the lock to a site when profiling. Called with the lock held.
+		 *  \private
+		**/
+		void chargeLock(fq_lock_site site) {
+#if FQ_LOCK_PROFILING
+			mutex_.site(site);
+#else
+			(void) site;
+#endif
+		}
+
+		/*! \brief Remove and return the item at the front of the queue.
+		 *  \private
+		**/
+		BaseClassPointer take() {
+			BaseClassPointer item = std::move(theQueue_.front());
+			theQueue_.pop_front();
+			unsigned long long stamp = stamps_.front();
+			stamps_.pop_front();
+			if (stamp != 0) {
+				unsigned long long age = fq_stamp_age(stamp, fq_stamp_nanos());
+				fq_count(counters_.queuedNanos, age);
+				recordLatency(fq_latency_in_queue, age);
+			}
+			--itemCount_;
+			residentBytes_ -= sizes_.front();
+			sizes_.pop_front();
+			fq_count(counters_.popped, 1);
+			return item;
+		}
+
+		/*! \brief Write the oldest items of the queue into a new failover file.
+		 *  \private
+		**/
+		void spill() {
+			fq_trace_scope trace("spill");
+			unsigned long long start = fq_now_nanos();
+			chargeLock(fq_lock_spill);
+			// Spilling for the byte budget takes the oldest items until enough bytes are covered.
+			bool byBytes = maxBytes_ > 0 && itemCount_ <= maxSize_;
+			std::size_t target = FQ_DUMP_BYTES(maxBytes_);
+			int limit = FQ_DUMP_SIZE(maxSize_);
+			int c = 0;
+			std::size_t bytes = 0;
+			fq_container<BaseClass> container;
+			typename fq_block_queue<BaseClassPointer>::iterator end = theQueue_.end();
+			typename fq_block_queue<unsigned long long>::iterator stamp = stamps_.begin();
+			typename fq_block_queue<std::size_t>::iterator size = sizes_.begin();
+			unsigned long long oldest = 0;
+			for (typename fq_block_queue<BaseClassPointer>::iterator it = theQueue_.begin(); it != end; ++it, ++stamp, ++size) {
+				if (byBytes ? (c > 0 && bytes >= target) : c >= limit) {
+					break;
+				}
+				const BaseClass &item = fq_pointer_traits<BaseClass, BaseClassPointer>::get(*it);
+				container.add(item, *stamp);
+				if (*stamp != 0 && (oldest == 0 || *stamp < oldest)) {
+					oldest = *stamp;
+				}
+				bytes += *size;
+				++c;
+			}
+
+			std::string fileName = failOverFile();
+			FQ_LOG(fq_log_info, "Saving: " << fileName << " (" << c << " items)");
+			std::ofstream ofs(fileName.c_str(), std::ios::out | std::ios::binary);
+			{
+				FQ_OARCHIVE oa(ofs);
+				oa << container;
+			}
+			if (!ofs) {
+				FQ_LOG(fq_log_error, "Could not write: " << fileName);
+			}
+			failOverFiles_.front().bytes = ofs.tellp();
+			failOverFiles_.front().items = c;
+			failOverFiles_.front().stamp = oldest;
+			diskBytes_ += failOverFiles_.front().bytes;
+			diskItems_ += c;
+			theQueue_.pop_front(c);
+			stamps_.pop_front(c);
+			sizes_.pop_front(c);
+			itemCount_ -= c;
+			residentBytes_ -= bytes;
+			fq_count(counters_.spills, 1);
+			fq_count(counters_.itemsSpilled, c);
+			fq_count(counters_.bytesSpilled, failOverFiles_.front().bytes);
+			unsigned long long elapsed = fq_now_nanos() - start;
+			fq_count(counters_.spillNanos, elapsed);
+			recordLatency(fq_latency_spill, elapsed);
+		}
+
+		/*! \brief The estimated in-memory size of an item, or 0 without a byte budget or for a null pointer.
+		 *  \private
+		**/
+		std::size_t itemBytes(const BaseClassPointer &item) const {
+			if (maxBytes_ == 0) {
+				return 0;
+			}
+			const BaseClass *object = fq_pointer_traits<BaseClass, BaseClassPointer>::address(item);
+			return object ? fq_size_estimator<BaseClass>::size(*object) : 0;
+		}
 
 		/*! \brief Attempt to determine if a failover file needs to be read and so.
 		 *  \private
 		**/
 		bool fill() {
-			if (itemCount_ > minCount_ || failOverCount_ == 0) {
+			if ((maxBytes_ > 0 ? residentBytes_ > minBytes_ : itemCount_ > minCount_) || failOverCount_ == 0) {
 				return true;
 			}
-			std::string fileName = nextFailOverFile();
-			FQD("Loading: " << fileName)
+			fq_trace_scope trace("reload");
+			unsigned long long start = fq_now_nanos();
+			chargeLock(fq_lock_reload);
+			fq_file next = nextFailOverFile();
+			std::string fileName = next.name;
+			diskBytes_ -= next.bytes;
+			diskItems_ -= next.items;
+			FQ_LOG(fq_log_info, "Loading: " << fileName);
 
 			boost::filesystem::path failOverFile(fileName);
 			if (!boost::filesystem::exists(failOverFile)) {
+				FQ_LOG(fq_log_warn, "Skipping missing file: " << fileName);
+				fq_count(counters_.missingFiles, 1);
+				updateReady();
 				return false;
 			}
-			std::ifstream ifs(fileName.c_str());
-			boost::archive::text_iarchive ia(ifs);
-			fq_container container;
-			ia >> container;
-			std::queue<BaseClassPointer> newQueue;
-			for (int i = 0; i < (int) container.data.size(); i++) {
-				BaseClassPointer item(new BaseClass(container.data[i]));
-				newQueue.push(item);
-				++itemCount_;
+			fq_container<BaseClass> container;
+			try {
+				std::ifstream ifs(fileName.c_str(), std::ios::in | std::ios::binary);
+				FQ_IARCHIVE ia(ifs);
+				ia >> container;
+			} catch (const std::exception &) {
+				// A truncated or damaged file cannot be read back; drop it rather than fail every pop.
+				FQ_LOG(fq_log_warn, "Skipping corrupt file: " << fileName);
+				deleteFile(fileName);
+				fq_count(counters_.corruptFiles, 1);
+				// The dropped file may have been the last thing left to pop.
+				updateReady();
+				return false;
 			}
-			while (!theQueue_.empty()) {
-				newQueue.push(theQueue_.front());
-				theQueue_.pop();
+			// Items from files written without push times are given the oldest time known for the file.
+			container.stamps.resize(container.data.size(), next.stamp);
+			for (int i = (int) container.data.size() - 1; i >= 0; i--) {
+				theQueue_.push_front(factory_(std::move(container.data[i])));
+				stamps_.push_front(container.stamps[i]);
+				sizes_.push_front(itemBytes(theQueue_.front()));
+				++itemCount_;
+				residentBytes_ += sizes_.front();
 			}
-			theQueue_ = newQueue;
 			deleteFile(fileName);
-			condition_.notify_one();
+			fq_count(counters_.reloads, 1);
+			fq_count(counters_.itemsReloaded, container.data.size());
+			fq_count(counters_.bytesReloaded, next.bytes);
+			unsigned long long elapsed = fq_now_nanos() - start;
+			fq_count(counters_.reloadNanos, elapsed);
+			recordLatency(fq_latency_reload, elapsed);
+			if (waiters_ > 0) {
+				notifyOne();
+			}
 			return true;
 		}
 
@@ -274,16 +2710,20 @@ class FailoverQueue {
 			if (!boost::filesystem::is_directory(failOverPath_)) {
 				return;
 			}
-			std::vector<std::string> tmpList;
 			boost::filesystem::directory_iterator end_iter;
 			for (boost::filesystem::directory_iterator dir_itr(failOverPath_); dir_itr != end_iter; ++dir_itr) {
 				if (boost::filesystem::is_regular_file(dir_itr->status())) {
-					std::string fileName = dir_itr->path().filename();
-					if (fileName.find(FQ_FILENAME) == 0) {
-						std::stringstream output;
+					std::string fileName = dir_itr->path().filename().string();
+					if (fileName.compare(0, failOverPrefix_.size(), failOverPrefix_) == 0 && isdigit((unsigned char) fileName[failOverPrefix_.size()])) {
 						++failOverCount_;
-						output << failOverPath_ << fileName;
-						failOverFiles_.insert(failOverFiles_.begin(), output.str());
+						// The item count of a file from an earlier run is not known without reading it.
+						// Its items are at least as old as its modification time.
+						fq_file file = { failOverPath_ + fileName, fq_failover_id(fileName), 0, (long) FQ_DUMP_SIZE(maxSize_), 0 };
+						fq_file_status(file.name, file.bytes, file.stamp);
+						diskBytes_ += file.bytes;
+						diskItems_ += file.items;
+						failOverId_ = std::max(failOverId_, file.id);
+						failOverFiles_.push_back(file);
 					}
 				}
 			}
@@ -295,16 +2735,19 @@ class FailoverQueue {
 		**/
 		std::string failOverFile() {
 			std::stringstream output;
-			output << failOverPath_ << FQ_FILENAME << ++failOverCount_ << FQ_EXT;
-			failOverFiles_.insert(failOverFiles_.begin(), output.str());
+			// Ids keep increasing so that a new file never reuses the name of one still waiting to be read.
+			++failOverCount_;
+			output << failOverPath_ << failOverPrefix_ << ++failOverId_ << FQ_EXT;
+			fq_file file = { output.str(), failOverId_, 0, 0, 0 };
+			failOverFiles_.push_front(file);
 			return output.str();
 		}
 
 		/*! \brief Find and remove a failover filename to be used.
 		 *  \private
 		**/
-		std::string nextFailOverFile() {
-			std::string next = failOverFiles_.back();
+		fq_file nextFailOverFile() {
+			fq_file next = failOverFiles_.back();
 			failOverFiles_.pop_back();
 			--failOverCount_;
 			return next;
@@ -320,17 +2763,27 @@ class FailoverQueue {
 			}
 		}
 
-		/*! \brief A small compare method used to sort failover files.
+		/*! \brief A small compare method used to sort failover files by the id parsed from their names.
 		 *  \private
 		**/
-		static bool failover_compare(std::string first, std::string second) {
-			// The + 2 is added to represent the './' prefix to each of these strings.
-			std::string stringIdA = first.substr(strlen(FQ_FILENAME) + 2, first.length() - strlen(FQ_EXT));
-			std::string stringIdB = second.substr(strlen(FQ_FILENAME) + 2, second.length() - strlen(FQ_EXT));
-			int idA = atoi(stringIdA.c_str());
-			int idB = atoi(stringIdB.c_str());
-			return idA <= idB;
+		static bool failover_compare(const fq_file &first, const fq_file &second) {
+			return first.id < second.id;
 		}
+
+#if FQ_COROUTINES
+		// Coroutines suspended in async_pop() and async_push(), oldest first, protected by mutex_.
+		PopAwaiter *popHead_;
+		PopAwaiter *popTail_;
+		PushAwaiter *pushHead_;
+		PushAwaiter *pushTail_;
+		std::function<void(std::coroutine_handle<>)> resumeHook_;
+#endif
+
+#if FQ_EVENTFD
+		// The readiness descriptor and whether it is readable, protected by mutex_.
+		int readyFd_;
+		bool readySignalled_;
+#endif
 };
 
 #endif
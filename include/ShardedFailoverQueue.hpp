@@ -0,0 +1,233 @@
+#ifndef __SHARDEDFAILOVERQUEUE_H__
+#define __SHARDEDFAILOVERQUEUE_H__
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include "FailoverQueue.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*!
+ * \class ShardedFailoverQueue
+ * \brief A set of FailoverQueue shards with independent locks and failover files.
+ *
+ * Each shard is a FailoverQueue with its own mutex, in-memory queue and
+ * failover files. Producers are spread over the shards round-robin, or by a
+ * caller supplied hash to keep related items on one shard. Consumers pop from
+ * a home shard and steal from the other shards when it is empty, blocking only
+ * when every shard is empty.
+ *
+ * Shard failover files are named FQ_FILENAME "-s<shard>-<id>" FQ_EXT, so a
+ * sharded queue constructed over an existing directory restores each shard
+ * from its own files. Order is only kept within a shard.
+ *
+ * clear() empties every shard and releases consumers blocked in popw(),
+ * which then receive a default constructed BaseClassPointer, as with
+ * FailoverQueue::clear().
+ *
+ *  \author Nick Gerakines <ngerakines@blizzard.com>
+ *  \version 0.2.0
+**/
+template <class BaseClass, class BaseClassPointer, class Factory = fq_default_factory<BaseClass, BaseClassPointer> >
+class ShardedFailoverQueue {
+	public:
+		typedef FailoverQueue<BaseClass, BaseClassPointer, Factory> shard_type;
+
+	private:
+		std::vector<boost::shared_ptr<shard_type> > shards_;
+
+		// Producers take turns on the round-robin counter and bump the sequence that consumers poll.
+		FQ_FIELD_ALIGN std::atomic<unsigned int> nextShard_;
+		FQ_FIELD_ALIGN std::atomic<unsigned long> sequence_;
+
+		FQ_FIELD_ALIGN boost::mutex mutex_;
+		boost::condition_variable condition_;
+		std::atomic<int> waiters_;
+		std::atomic<bool> cleared_;
+
+	public:
+		//! Construct a sharded failover queue.
+		/*! \param path The directory that failover files are saved in.
+		 *  \param shards The number of shards.
+		 *  \param maxSize The item count at which each shard dumps items into failover files.
+		 *  \param factory The functor used to create items read back from failover files.
+		**/
+		ShardedFailoverQueue(std::string path, int shards, int maxSize, Factory factory = Factory()) : nextShard_(0), sequence_(0), waiters_(0), cleared_(false) {
+			for (int i = 0; i < shards; i++) {
+				shards_.push_back(boost::shared_ptr<shard_type>(new shard_type(path, shardPrefix(i), maxSize, factory)));
+			}
+		}
+
+		//! The deconstructor
+		~ShardedFailoverQueue() {
+			release();
+		}
+
+		//! Returns the number of shards.
+		int shards() const { return (int) shards_.size(); }
+
+		//! Returns one of the shards.
+		shard_type &shard(int index) { return *shards_[index]; }
+
+		//! Returns the number of items held in memory by all shards.
+		int size() {
+			int total = 0;
+			for (int i = 0; i < (int) shards_.size(); i++) {
+				total += shards_[i]->size();
+			}
+			return total;
+		}
+
+		//! Returns true if no shard holds items in memory.
+		bool empty() {
+			for (int i = 0; i < (int) shards_.size(); i++) {
+				if (!shards_[i]->empty()) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//! Adds an item to the next shard in round-robin order.
+		template <class Item>
+		bool push(Item &&item) {
+			return pushTo(nextShard_.fetch_add(1, std::memory_order_relaxed) % shards_.size(), std::forward<Item>(item));
+		}
+
+		//! Adds an item to the shard selected by a hash value.
+		/*! Items pushed with the same hash are popped in the order of their shard.
+		**/
+		template <class Item>
+		bool push(std::size_t hash, Item &&item) {
+			return pushTo(hash % shards_.size(), std::forward<Item>(item));
+		}
+
+		//! Constructs an item with the factory and adds it to the next shard in round-robin order.
+		template <class... Args>
+		bool emplace(Args&&... args) {
+			unsigned int index = nextShard_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+			bool result = shards_[index]->emplace(std::forward<Args>(args)...);
+			signal();
+			return result;
+		}
+
+		//! Empties every shard and optionally deletes their failover files.
+		/*! Consumers blocked in popw(), and any that call it once the
+		 *  shards are empty, return a default constructed BaseClassPointer.
+		**/
+		void clear(bool deleteFiles = true) {
+			for (int i = 0; i < (int) shards_.size(); i++) {
+				shards_[i]->clear(deleteFiles);
+			}
+			release();
+		}
+
+		//! Pops an item from the home shard, or from another shard if it is empty.
+		/*! \param home The shard this consumer prefers, for example its thread index.
+		 *  \param item Set to the popped item.
+		 *  \return true if an item was popped.
+		**/
+		bool try_pop(int home, BaseClassPointer &item) {
+			int count = (int) shards_.size();
+			for (int i = 0; i < count; i++) {
+				if (shards_[(home + i) % count]->try_pop(item)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//! Pops an item, waiting until one is pushed to any shard if necessary.
+		/*! This is a blocking operation. A consumer released by clear()
+		 *  receives a default constructed BaseClassPointer.
+		 *  \param home The shard this consumer prefers, for example its thread index.
+		**/
+		BaseClassPointer popw(int home) {
+			BaseClassPointer item;
+			for (;;) {
+				unsigned long seen = sequence_.load();
+				if (try_pop(home, item)) {
+					return item;
+				}
+				if (cleared_.load()) {
+					return BaseClassPointer();
+				}
+
+				// Announce the wait before checking the sequence again so a concurrent push either
+				// changes the sequence before the check or sees the waiter and signals.
+				++waiters_;
+				{
+					boost::mutex::scoped_lock lock(mutex_);
+					while (sequence_.load() == seen && !cleared_.load()) {
+						condition_.wait(lock);
+					}
+				}
+				--waiters_;
+			}
+		}
+
+	private:
+		template <class Item>
+		bool pushTo(unsigned int index, Item &&item) {
+			bool result = shards_[index]->push(std::forward<Item>(item));
+			signal();
+			return result;
+		}
+
+		/*! \brief Wake a blocked consumer after a push, if there is one.
+		 *  \private
+		**/
+		void signal() {
+			++sequence_;
+			if (waiters_.load() > 0) {
+				boost::mutex::scoped_lock lock(mutex_);
+				condition_.notify_one();
+			}
+		}
+
+		/*! \brief Release every blocked consumer for good.
+		 *  \private
+		**/
+		void release() {
+			boost::mutex::scoped_lock lock(mutex_);
+			cleared_.store(true);
+			++sequence_;
+			condition_.notify_all();
+		}
+
+		/*! \brief The failover file name prefix of a shard.
+		 *  \private
+		**/
+		static std::string shardPrefix(int index) {
+			std::stringstream output;
+			output << FQ_FILENAME << "-s" << index << "-";
+			return output.str();
+		}
+};
+
+#endif
@@ -0,0 +1,480 @@
+#ifndef __SPSCFAILOVERQUEUE_H__
+#define __SPSCFAILOVERQUEUE_H__
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include "FailoverQueue.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*!
+ * \class SpscFailoverQueue
+ * \brief A failover queue for exactly one producer thread and one consumer thread.
+ *
+ * Items travel through a wait-free ring of maxSize slots, rounded up to a
+ * power of two, indexed by an acquire/release head and tail. When the ring is
+ * full the producer stages new items and writes every FQ_DUMP_SIZE(N) of them
+ * into a failover file, which is handed to the consumer through a lock-free
+ * list. The consumer reads a file back once it has popped every ring item
+ * pushed before the file, so items are popped in the order they were pushed.
+ *
+ * Neither side takes a lock while items fit in the ring. The consumer only
+ * parks on a condition variable when the ring, the reloaded items, the file
+ * list and the staged items are all empty, and the producer only takes the
+ * lock to wake it or, while the ring is full, to stage an item.
+ *
+ * Staged items that have not filled a failover file yet are claimed by the
+ * consumer under the lock once it has popped everything pushed before them,
+ * so they never wait on the producer. They are written to a failover file
+ * when the queue is destroyed.
+ *
+ *  \author Nick Gerakines <ngerakines@blizzard.com>
+ *  \version 0.2.0
+**/
+template <class BaseClass, class BaseClassPointer, class Factory = fq_default_factory<BaseClass, BaseClassPointer> >
+class SpscFailoverQueue {
+	private:
+		typedef typename std::aligned_storage<sizeof(BaseClassPointer), alignof(BaseClassPointer)>::type slot_type;
+
+		/*! \brief A failover file handed from the producer to the consumer.
+		 *  \private
+		**/
+		struct fq_file_node {
+			std::string name;
+			std::size_t position;
+			std::atomic<fq_file_node *> next;
+		};
+
+		std::vector<slot_type> ring_;
+		std::size_t mask_;
+		int dumpSize_;
+		std::string failOverPath_;
+		Factory factory_;
+
+		alignas(FQ_CACHE_LINE) std::atomic<std::size_t> head_;
+		std::size_t tailCache_;
+		fq_file_node *files_;
+		fq_block_queue<BaseClassPointer> reloaded_;
+
+		alignas(FQ_CACHE_LINE) std::atomic<std::size_t> tail_;
+		std::size_t headCache_;
+		fq_file_node *lastFile_;
+		std::vector<BaseClassPointer> staged_;
+		bool overflowing_;
+		long filesPublished_;
+		long failOverId_;
+
+		alignas(FQ_CACHE_LINE) std::atomic<long> filesConsumed_;
+		std::atomic<unsigned long> missingFiles_;
+		std::atomic<unsigned long> corruptFiles_;
+		std::atomic<bool> staging_;
+		std::atomic<bool> waiting_;
+		boost::mutex mutex_;
+		boost::condition_variable condition_;
+
+	public:
+		//! Construct a single producer, single consumer failover queue.
+		/*! Failover files left in the directory are read back before any
+		 *  new item, oldest first.
+		 *  \param path The directory that failover files are saved in.
+		 *  \param maxSize The minimum number of items the ring holds before items are dumped into failover files.
+		 *  \param factory The functor used to create items read back from failover files.
+		**/
+		SpscFailoverQueue(std::string path, int maxSize, Factory factory = Factory()) : mask_(0), dumpSize_(FQ_DUMP_SIZE(maxSize)), failOverPath_(path), factory_(factory), head_(0), tailCache_(0), tail_(0), headCache_(0), overflowing_(false), filesPublished_(0), failOverId_(0), filesConsumed_(0), missingFiles_(0), corruptFiles_(0), staging_(false), waiting_(false) {
+			std::size_t capacity = 1;
+			while (capacity < (std::size_t) maxSize) {
+				capacity <<= 1;
+			}
+			ring_.resize(capacity);
+			mask_ = capacity - 1;
+			if (dumpSize_ < 1) {
+				dumpSize_ = 1;
+			}
+			files_ = lastFile_ = new fq_file_node();
+			files_->position = 0;
+			files_->next.store(0);
+
+			bootstrap();
+		}
+
+		//! The deconstructor
+		/*! Staged items are written to a failover file. Items in the ring
+		 *  are discarded, as with FailoverQueue.
+		**/
+		~SpscFailoverQueue() {
+			if (!staged_.empty()) {
+				publish();
+			}
+			for (std::size_t i = head_.load(); i != tail_.load(); i++) {
+				reinterpret_cast<BaseClassPointer *>(&ring_[i & mask_])->~BaseClassPointer();
+			}
+			while (files_) {
+				fq_file_node *node = files_;
+				files_ = node->next.load();
+				delete node;
+			}
+			condition_.notify_all();
+		}
+
+		//! Returns the number of items in the ring.
+		/*! Staged items and items in failover files are not counted.
+		**/
+		int size() const {
+			return (int) (tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire));
+		}
+
+		//! Returns true if the ring is empty.
+		bool empty() const {
+			return size() == 0;
+		}
+
+		//! Returns the number of failover files that were gone when the consumer reached them.
+		unsigned long missingFiles() const {
+			return missingFiles_.load(std::memory_order_relaxed);
+		}
+
+		//! Returns the number of failover files that could not be read back and were deleted.
+		unsigned long corruptFiles() const {
+			return corruptFiles_.load(std::memory_order_relaxed);
+		}
+
+		//! Adds an item to the queue. Must only be called from the producer thread.
+		bool push(const BaseClassPointer &item) {
+			return enqueue(item);
+		}
+
+		//! Adds an item to the queue, moving it into place. Must only be called from the producer thread.
+		bool push(BaseClassPointer &&item) {
+			return enqueue(std::move(item));
+		}
+
+		//! Constructs an item with the factory and adds it to the queue. Must only be called from the producer thread.
+		template <class... Args>
+		bool emplace(Args&&... args) {
+			return enqueue(factory_(std::forward<Args>(args)...));
+		}
+
+		//! Moves staged items out of memory. Must only be called from the producer thread.
+		/*! Staged items are moved into the ring if the consumer has
+		 *  caught up, otherwise they are written to a failover file.
+		**/
+		void flush() {
+			if (overflowing_) {
+				drain();
+			}
+			if (overflowing_) {
+				publish();
+			}
+		}
+
+		//! Pops an item if one is available. Must only be called from the consumer thread.
+		/*! \param item Set to the popped item.
+		 *  \return true if an item was popped.
+		**/
+		bool try_pop(BaseClassPointer &item) {
+			for (;;) {
+				if (!reloaded_.empty()) {
+					item = std::move(reloaded_.front());
+					reloaded_.pop_front();
+					return true;
+				}
+				std::size_t head = head_.load(std::memory_order_relaxed);
+				fq_file_node *next = files_->next.load(std::memory_order_acquire);
+				if (next && next->position <= head) {
+					delete files_;
+					files_ = next;
+					// Reloaded items are popped before the ring, so the producer may move on before the file is read.
+					filesConsumed_.fetch_add(1, std::memory_order_release);
+					reload(next->name);
+					continue;
+				}
+				if (head == tailCache_) {
+					tailCache_ = tail_.load(std::memory_order_acquire);
+					if (head == tailCache_) {
+						if (!staging_.load(std::memory_order_acquire)) {
+							return false;
+						}
+						claim();
+						continue;
+					}
+				}
+				BaseClassPointer *slot = reinterpret_cast<BaseClassPointer *>(&ring_[head & mask_]);
+				item = std::move(*slot);
+				slot->~BaseClassPointer();
+				head_.store(head + 1, std::memory_order_release);
+				return true;
+			}
+		}
+
+		//! Pops an item, waiting until one is available if necessary. Must only be called from the consumer thread.
+		/*! This is a blocking operation.
+		**/
+		BaseClassPointer popw() {
+			BaseClassPointer item;
+			while (!try_pop(item)) {
+				waiting_.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!available()) {
+					boost::mutex::scoped_lock lock(mutex_);
+					while (waiting_.load(std::memory_order_relaxed) && !available()) {
+						condition_.wait(lock);
+					}
+				}
+				waiting_.store(false, std::memory_order_relaxed);
+			}
+			return item;
+		}
+
+	private:
+		/*! \brief Add an item to the ring, or stage it once the ring is full.
+		 *  \private
+		**/
+		template <class Item>
+		bool enqueue(Item &&item) {
+			if (overflowing_) {
+				drain();
+			}
+			if (overflowing_ || !tryPush(std::forward<Item>(item))) {
+				overflowing_ = true;
+				bool full = false;
+				{
+					boost::mutex::scoped_lock lock(mutex_);
+					staged_.push_back(std::forward<Item>(item));
+					staging_.store(true, std::memory_order_release);
+					full = (int) staged_.size() >= dumpSize_;
+				}
+				if (full) {
+					publish();
+				} else {
+					signal();
+				}
+				return true;
+			}
+			signal();
+			return true;
+		}
+
+		/*! \brief Move staged items into the ring once the consumer has read every published file.
+		 *  \private
+		**/
+		void drain() {
+			if (filesConsumed_.load(std::memory_order_acquire) != filesPublished_) {
+				return;
+			}
+			std::size_t moved = 0;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while (moved < staged_.size() && tryPush(std::move(staged_[moved]))) {
+					++moved;
+				}
+				staged_.erase(staged_.begin(), staged_.begin() + moved);
+				if (staged_.empty()) {
+					staging_.store(false, std::memory_order_relaxed);
+					overflowing_ = false;
+				}
+			}
+			if (moved > 0) {
+				signal();
+			}
+		}
+
+		/*! \brief Construct an item in the next ring slot if there is room.
+		 *  \private
+		**/
+		template <class Item>
+		bool tryPush(Item &&item) {
+			std::size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail - headCache_ > mask_) {
+				headCache_ = head_.load(std::memory_order_acquire);
+				if (tail - headCache_ > mask_) {
+					return false;
+				}
+			}
+			new (&ring_[tail & mask_]) BaseClassPointer(std::forward<Item>(item));
+			tail_.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/*! \brief Write the staged items into a failover file and hand it to the consumer.
+		 *  \private
+		**/
+		void publish() {
+			std::vector<BaseClassPointer> batch;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				batch.swap(staged_);
+				staging_.store(false, std::memory_order_relaxed);
+			}
+			if (batch.empty()) {
+				// The consumer claimed the staged items first.
+				return;
+			}
+			std::stringstream output;
+			output << failOverPath_ << FQ_FILENAME << ++failOverId_ << FQ_EXT;
+			{
+				std::ofstream ofs(output.str().c_str(), std::ios::out | std::ios::binary);
+				FQ_OARCHIVE oa(ofs);
+				fq_container<BaseClass> container;
+				for (std::size_t i = 0; i < batch.size(); i++) {
+					container.add(fq_pointer_traits<BaseClass, BaseClassPointer>::get(batch[i]));
+				}
+				oa << container;
+			}
+			// Every item already in the ring was pushed before the staged items.
+			append(output.str(), tail_.load(std::memory_order_relaxed));
+			++filesPublished_;
+			signal();
+		}
+
+		/*! \brief Link a failover file onto the list read by the consumer.
+		 *  \private
+		**/
+		void append(const std::string &name, std::size_t position) {
+			fq_file_node *node = new fq_file_node();
+			node->name = name;
+			node->position = position;
+			node->next.store(0, std::memory_order_relaxed);
+			lastFile_->next.store(node, std::memory_order_release);
+			lastFile_ = node;
+		}
+
+		/*! \brief Wake the consumer if it is parked.
+		 *  \private
+		**/
+		void signal() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiting_.load(std::memory_order_relaxed)) {
+				boost::mutex::scoped_lock lock(mutex_);
+				waiting_.store(false, std::memory_order_relaxed);
+				condition_.notify_one();
+			}
+		}
+
+		/*! \brief Take the staged items once every ring item and failover file before them has been popped.
+		 *  \private
+		**/
+		void claim() {
+			boost::mutex::scoped_lock lock(mutex_);
+			if (files_->next.load(std::memory_order_acquire) != 0 || head_.load(std::memory_order_relaxed) != tail_.load(std::memory_order_acquire)) {
+				return;
+			}
+			for (std::size_t i = 0; i < staged_.size(); i++) {
+				reloaded_.push_back(std::move(staged_[i]));
+			}
+			staged_.clear();
+			staging_.store(false, std::memory_order_relaxed);
+		}
+
+		/*! \brief Returns true if the consumer has something to pop.
+		 *  \private
+		**/
+		bool available() {
+			return !reloaded_.empty() || files_->next.load(std::memory_order_acquire) != 0 || head_.load(std::memory_order_relaxed) != tail_.load(std::memory_order_acquire) || staging_.load(std::memory_order_acquire);
+		}
+
+		/*! \brief Read a failover file into the reloaded items.
+		 *  \private
+		**/
+		void reload(const std::string &fileName) {
+			FQ_LOG(fq_log_info, "Loading: " << fileName);
+			boost::filesystem::path failOverFile(fileName);
+			if (!boost::filesystem::exists(failOverFile)) {
+				FQ_LOG(fq_log_warn, "Skipping missing file: " << fileName);
+				missingFiles_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			fq_container<BaseClass> container;
+			try {
+				std::ifstream ifs(fileName.c_str(), std::ios::in | std::ios::binary);
+				FQ_IARCHIVE ia(ifs);
+				ia >> container;
+			} catch (const std::exception &) {
+				// A truncated or damaged file cannot be read back; drop it rather than fail every pop.
+				FQ_LOG(fq_log_warn, "Skipping corrupt file: " << fileName);
+				boost::filesystem::remove(failOverFile);
+				corruptFiles_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			for (std::size_t i = 0; i < container.data.size(); i++) {
+				reloaded_.push_back(factory_(std::move(container.data[i])));
+			}
+			boost::filesystem::remove(failOverFile);
+		}
+
+		/*! \brief Hand any existing failover files to the consumer, oldest first.
+		 *  \private
+		**/
+		void bootstrap() {
+			if (!boost::filesystem::is_directory(failOverPath_)) {
+				return;
+			}
+			std::vector<std::pair<long, std::string> > found;
+			std::string prefix = FQ_FILENAME;
+			boost::filesystem::directory_iterator end_iter;
+			for (boost::filesystem::directory_iterator dir_itr(failOverPath_); dir_itr != end_iter; ++dir_itr) {
+				if (boost::filesystem::is_regular_file(dir_itr->status())) {
+					std::string fileName = dir_itr->path().filename().string();
+					if (fileName.compare(0, prefix.size(), prefix) == 0 && isdigit((unsigned char) fileName[prefix.size()])) {
+						found.push_back(std::make_pair(fq_failover_id(fileName), failOverPath_ + fileName));
+					}
+				}
+			}
+			std::sort(found.begin(), found.end());
+			for (std::size_t i = 0; i < found.size(); i++) {
+				append(found[i].second, 0);
+				failOverId_ = found[i].first;
+				++filesPublished_;
+			}
+		}
+
+		SpscFailoverQueue(const SpscFailoverQueue &);
+		SpscFailoverQueue &operator=(const SpscFailoverQueue &);
+};
+
+//! Selects a multiple producer, multiple consumer FailoverQueue.
+struct fq_mpmc { };
+
+//! Selects a single producer, single consumer SpscFailoverQueue.
+struct fq_spsc { };
+
+/*!
+ * \class fq_queue
+ * \brief Selects a queue implementation from a concurrency policy at compile time.
+ *
+ * fq_queue<Counter, CounterPtr, fq_spsc>::type is an SpscFailoverQueue and
+ * fq_queue<Counter, CounterPtr>::type is a FailoverQueue.
+**/
+template <class BaseClass, class BaseClassPointer, class Concurrency = fq_mpmc, class Factory = fq_default_factory<BaseClass, BaseClassPointer> >
+struct fq_queue {
+	typedef FailoverQueue<BaseClass, BaseClassPointer, Factory> type;
+};
+
+template <class BaseClass, class BaseClassPointer, class Factory>
+struct fq_queue<BaseClass, BaseClassPointer, fq_spsc, Factory> {
+	typedef SpscFailoverQueue<BaseClass, BaseClassPointer, Factory> type;
+};
+
+#endif
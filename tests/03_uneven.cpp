@@ -62,7 +62,7 @@ void reset() {
 	boost::filesystem::directory_iterator end_iter;
 	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
 		if (boost::filesystem::is_regular_file(dir_itr->status())) {
-			std::string fileName = dir_itr->path().filename();
+			std::string fileName = dir_itr->path().filename().string();
 			if (fileName.find("failover") == 0) {
 				boost::filesystem::remove(dir_itr->path().filename());
 			}
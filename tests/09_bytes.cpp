@@ -0,0 +1,145 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/shared_ptr.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/serialization/string.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#define TEST_PATH "./"
+
+class Payload {
+public:
+	Payload() : id_(0) { }
+	Payload(int id, int bytes) : id_(id), data_(bytes, 'x') { }
+	~Payload() { }
+	int id() const { return id_; }
+	const std::string &data() const { return data_; }
+	void resize(int bytes) { data_.resize(bytes, 'x'); }
+private:
+	friend class boost::serialization::access;
+
+	int id_;
+	std::string data_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & id_;
+		ar & data_;
+	}
+};
+
+template <>
+struct fq_size_estimator<Payload> {
+	static std::size_t size(const Payload &item) {
+		return item.data().size();
+	}
+};
+
+typedef boost::shared_ptr<Payload> PayloadPtr;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+int main() {
+	reset();
+
+	FailoverQueue<Payload, PayloadPtr> payloadQueue(TEST_PATH, 1000000);
+	payloadQueue.byteBudget(10000);
+	assert(payloadQueue.residentBytes() == 0);
+
+	for (int i = 0; i < 5; i++) {
+		payloadQueue.push(PayloadPtr(new Payload(i, 1000)));
+	}
+	assert(payloadQueue.residentBytes() == 5000);
+	assert(payloadQueue.diskBytes() == 0);
+
+	// A large item forces the oldest items out until half of the budget has been spilled.
+	payloadQueue.push(PayloadPtr(new Payload(5, 8000)));
+	assert(payloadQueue.failOverFiles().size() == 1);
+	assert(payloadQueue.size() == 1);
+	assert(payloadQueue.residentBytes() == 8000);
+	assert(payloadQueue.diskBytes() > 5000);
+
+	for (int i = 6; i < 40; i++) {
+		payloadQueue.push(PayloadPtr(new Payload(i, 100 + (i % 3) * 1000)));
+		assert(payloadQueue.residentBytes() <= 10000);
+	}
+
+	int popped = 0;
+	while (payloadQueue.size() > 0 || !payloadQueue.failOverFiles().empty()) {
+		PayloadPtr pptr = payloadQueue.popw();
+		assert(pptr->data().size() > 0);
+		assert(payloadQueue.residentBytes() <= 10000);
+		++popped;
+	}
+	assert(popped == 40);
+	assert(payloadQueue.residentBytes() == 0);
+	assert(payloadQueue.diskBytes() == 0);
+
+	// Items count for the size they had when pushed, even if they change while queued.
+	PayloadPtr shared(new Payload(40, 1000));
+	payloadQueue.push(shared);
+	shared->resize(3000);
+	assert(payloadQueue.residentBytes() == 1000);
+	payloadQueue.popw();
+	assert(payloadQueue.residentBytes() == 0);
+
+	// A null item counts as 0 bytes.
+	payloadQueue.push(PayloadPtr());
+	assert(payloadQueue.size() == 1 && payloadQueue.residentBytes() == 0);
+	assert(!payloadQueue.popw());
+
+	// Without a budget sizes are not estimated, and null items are accepted as before.
+	FailoverQueue<Payload, PayloadPtr> plainQueue(TEST_PATH, 10);
+	plainQueue.push(PayloadPtr());
+	plainQueue.push(PayloadPtr(new Payload(1, 1000)));
+	assert(plainQueue.residentBytes() == 0);
+	assert(!plainQueue.popw());
+
+	// Setting a budget estimates the items already queued.
+	plainQueue.byteBudget(10000);
+	assert(plainQueue.residentBytes() == 1000);
+	assert(plainQueue.popw()->id() == 1);
+	assert(plainQueue.residentBytes() == 0);
+
+	return 0;
+}
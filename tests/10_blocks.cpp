@@ -0,0 +1,85 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/shared_ptr.hpp>
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main() {
+	fq_block_queue<int, 8> blockQueue;
+	assert(blockQueue.empty());
+	assert(blockQueue.blocks() == 0);
+
+	// Grow in both directions across several blocks and check the order.
+	for (int i = 0; i < 50; i++) {
+		blockQueue.push_back(i);
+	}
+	for (int i = -1; i >= -50; i--) {
+		blockQueue.push_front(i);
+	}
+	assert(blockQueue.size() == 100);
+
+	int expected = -50;
+	for (fq_block_queue<int, 8>::iterator it = blockQueue.begin(); it != blockQueue.end(); ++it) {
+		assert(*it == expected++);
+	}
+	for (int i = -50; i < 50; i++) {
+		assert(blockQueue.front() == i);
+		blockQueue.pop_front();
+	}
+	assert(blockQueue.empty());
+
+	// Blocks are reused rather than allocated again.
+	size_t blocks = blockQueue.blocks();
+	for (int cycle = 0; cycle < 10; cycle++) {
+		for (int i = 0; i < 100; i++) {
+			if (i % 2) {
+				blockQueue.push_back(i);
+			} else {
+				blockQueue.push_front(i);
+			}
+		}
+		blockQueue.pop_front(60);
+		assert(blockQueue.size() == 40);
+		blockQueue.clear();
+		assert(blockQueue.empty());
+	}
+	assert(blockQueue.blocks() == blocks);
+
+	fq_block_queue<boost::shared_ptr<string> > pointerQueue;
+	boost::shared_ptr<string> sptr(new string("failover"));
+	pointerQueue.push_back(sptr);
+	pointerQueue.push_back(sptr);
+	assert(sptr.use_count() == 3);
+	pointerQueue.pop_front();
+	assert(sptr.use_count() == 2);
+	pointerQueue.clear();
+	assert(sptr.use_count() == 1);
+
+	return 0;
+}
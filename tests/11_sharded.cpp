@@ -0,0 +1,151 @@
+
+#include "ShardedFailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+class Counter {
+public:
+	Counter() : count_(0) { }
+	explicit Counter(int count) : count_(count) { }
+	~Counter() { }
+	int count() { return count_; }
+private:
+	friend class boost::serialization::access;
+
+	int count_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & count_;
+	}
+};
+
+typedef boost::shared_ptr<Counter> CounterPtr;
+typedef ShardedFailoverQueue<Counter, CounterPtr> CounterQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void consume(CounterQueue *queue, int home, int count, vector<int> *seen) {
+	for (int i = 0; i < count; i++) {
+		CounterPtr cptr = queue->popw(home);
+		(*seen)[cptr->count()]++;
+	}
+}
+
+void wait(CounterQueue *queue, int home, CounterPtr *item) {
+	*item = queue->popw(home);
+}
+
+int main() {
+	reset();
+
+	{
+		CounterQueue counterQueue(TEST_PATH, 4, 10);
+		assert(counterQueue.shards() == 4);
+		for (int i = 0; i < 100; i++) {
+			counterQueue.push(CounterPtr(new Counter(i)));
+		}
+		assert(counterQueue.size() < 100);
+		for (int i = 0; i < 4; i++) {
+			vector<string> files = counterQueue.shard(i).failOverFiles();
+			assert(files.size() > 0);
+			stringstream prefix;
+			prefix << TEST_PATH << "failover-s" << i << "-";
+			for (size_t f = 0; f < files.size(); f++) {
+				assert(files[f].find(prefix.str()) == 0);
+			}
+		}
+		// A plain queue in the same directory does not pick up shard files.
+		FailoverQueue<Counter, CounterPtr> plainQueue(TEST_PATH, 10);
+		assert(plainQueue.failOverFiles().empty());
+	}
+
+	// Every shard is restored from its own files and two consumers drain all of them.
+	CounterQueue counterQueue(TEST_PATH, 4, 10);
+	for (int i = 0; i < 4; i++) {
+		assert(counterQueue.shard(i).failOverFiles().size() > 0);
+	}
+	int restored = 0;
+	CounterPtr cptr;
+	vector<int> seenA(100, 0), seenB(100, 0);
+	while (counterQueue.try_pop(0, cptr)) {
+		seenA[cptr->count()]++;
+		++restored;
+	}
+	assert(restored > 0 && restored < 100);
+
+	for (int i = 0; i < 100; i++) {
+		counterQueue.push(i, CounterPtr(new Counter(i)));
+	}
+	boost::thread consumerA(boost::bind(&consume, &counterQueue, 1, 50, &seenA));
+	boost::thread consumerB(boost::bind(&consume, &counterQueue, 2, 50, &seenB));
+	consumerA.join();
+	consumerB.join();
+
+	for (int i = 0; i < 100; i++) {
+		assert(seenA[i] + seenB[i] >= 1);
+	}
+	assert(counterQueue.size() == 0);
+
+	// clear() releases consumers blocked on an empty sharded queue.
+	vector<CounterPtr> released(2);
+	boost::thread waiterA(boost::bind(&wait, &counterQueue, 0, &released[0]));
+	boost::thread waiterB(boost::bind(&wait, &counterQueue, 1, &released[1]));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	counterQueue.clear(true);
+	waiterA.join();
+	waiterB.join();
+	assert(!released[0] && !released[1]);
+	assert(!counterQueue.popw(2));
+
+	reset();
+	return 0;
+}
@@ -0,0 +1,196 @@
+
+#include "SpscFailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+class Counter {
+public:
+	Counter() : count_(0) { }
+	explicit Counter(int count) : count_(count) { }
+	~Counter() { }
+	int count() { return count_; }
+private:
+	friend class boost::serialization::access;
+
+	int count_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & count_;
+	}
+};
+
+typedef boost::shared_ptr<Counter> CounterPtr;
+typedef fq_queue<Counter, CounterPtr, fq_spsc>::type CounterQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void produce(CounterQueue *queue, int count) {
+	for (int i = 0; i < count; i++) {
+		queue->emplace(i);
+		if (i % 1000 == 0) {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	}
+	queue->flush();
+}
+
+void consume(CounterQueue *queue, int count, vector<int> *popped) {
+	for (int i = 0; i < count; i++) {
+		popped->push_back(queue->popw()->count());
+	}
+}
+
+int main() {
+	reset();
+
+	static_assert(std::is_same<CounterQueue, SpscFailoverQueue<Counter, CounterPtr> >::value, "fq_spsc selects SpscFailoverQueue");
+	static_assert(std::is_same<fq_queue<Counter, CounterPtr>::type, FailoverQueue<Counter, CounterPtr> >::value, "fq_mpmc selects FailoverQueue");
+
+	{
+		// Items are popped in push order through the ring, staging and failover files.
+		CounterQueue counterQueue(TEST_PATH, 64);
+		boost::thread producer(boost::bind(&produce, &counterQueue, 20000));
+		for (int i = 0; i < 20000; i++) {
+			CounterPtr cptr = counterQueue.popw();
+			assert(cptr->count() == i);
+		}
+		producer.join();
+		CounterPtr cptr;
+		assert(!counterQueue.try_pop(cptr));
+	}
+
+	{
+		// Items staged behind a full ring reach the consumer without a flush.
+		CounterQueue counterQueue(TEST_PATH, 4);
+		for (int i = 0; i < 5; i++) {
+			counterQueue.emplace(i);
+		}
+		assert(counterQueue.size() == 4);
+		CounterPtr cptr;
+		for (int i = 0; i < 5; i++) {
+			assert(counterQueue.try_pop(cptr) && cptr->count() == i);
+		}
+		assert(!counterQueue.try_pop(cptr));
+
+		// A parked consumer is woken for them too.
+		vector<int> popped;
+		boost::thread consumer(boost::bind(&consume, &counterQueue, 5, &popped));
+		boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+		for (int i = 5; i < 10; i++) {
+			counterQueue.emplace(i);
+		}
+		consumer.join();
+		assert(popped.size() == 5);
+		for (int i = 0; i < 5; i++) {
+			assert(popped[i] == i + 5);
+		}
+	}
+
+	{
+		CounterQueue counterQueue(TEST_PATH, 64);
+		for (int i = 0; i < 200; i++) {
+			counterQueue.push(CounterPtr(new Counter(i)));
+		}
+		assert(counterQueue.size() == 64);
+	}
+
+	// Spilled and staged items are restored in order, ring items are not.
+	CounterQueue counterQueue(TEST_PATH, 64);
+	for (int i = 64; i < 200; i++) {
+		CounterPtr cptr = counterQueue.popw();
+		assert(cptr->count() == i);
+	}
+	CounterPtr cptr;
+	assert(!counterQueue.try_pop(cptr));
+
+	reset();
+
+	{
+		CounterQueue counterQueue(TEST_PATH, 4);
+		for (int i = 0; i < 20; i++) {
+			counterQueue.emplace(i);
+		}
+	}
+	{
+		// Damaged and deleted files are skipped and the queue keeps working.
+		stringstream name;
+		name << TEST_PATH << FQ_FILENAME << 1 << FQ_EXT;
+		ofstream ofs(name.str().c_str(), ios::out | ios::trunc);
+		ofs << "22 serialization::archive";
+	}
+	{
+		CounterQueue counterQueue(TEST_PATH, 4);
+		stringstream name;
+		name << TEST_PATH << FQ_FILENAME << 2 << FQ_EXT;
+		boost::filesystem::remove(name.str());
+		int previous = -1;
+		int count = 0;
+		while (counterQueue.try_pop(cptr)) {
+			assert(cptr->count() > previous);
+			previous = cptr->count();
+			++count;
+		}
+		assert(count == 12);
+		assert(counterQueue.corruptFiles() == 1 && counterQueue.missingFiles() == 1);
+		for (int i = 100; i < 110; i++) {
+			counterQueue.emplace(i);
+		}
+		for (int i = 100; i < 110; i++) {
+			assert(counterQueue.try_pop(cptr) && cptr->count() == i);
+		}
+	}
+
+	reset();
+	return 0;
+}
@@ -0,0 +1,137 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void consume(IntQueue *queue, int count, vector<int> *popped) {
+	for (int i = 0; i < count; i++) {
+		popped->push_back(queue->popw());
+	}
+}
+
+void pushAfter(IntQueue *queue, int millis, int item) {
+	if (millis > 0) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(millis));
+	} else {
+		boost::this_thread::yield();
+	}
+	queue->push(item);
+}
+
+void run(fq_wait_strategy strategy) {
+	IntQueue queue(TEST_PATH, 10);
+	queue.waitStrategy(strategy);
+
+	// Every item pushed while the consumer spins or blocks arrives, including spilled ones.
+	vector<int> popped;
+	boost::thread consumer(boost::bind(&consume, &queue, 100, &popped));
+	for (int i = 0; i < 100; i++) {
+		if (i % 10 == 0) {
+			boost::this_thread::yield();
+		}
+		queue.push(i);
+	}
+	consumer.join();
+	assert(popped.size() == 100);
+	// Spilled items come back after the ones kept in memory, so order is not preserved.
+	sort(popped.begin(), popped.end());
+	for (int i = 0; i < 100; i++) {
+		assert(popped[i] == i);
+	}
+
+	// clear() releases a consumer spinning or waiting on an empty queue.
+	popped.clear();
+	boost::thread waiter(boost::bind(&consume, &queue, 1, &popped));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	queue.clear(true);
+	waiter.join();
+	assert(popped.size() == 1);
+}
+
+void adapt() {
+	IntQueue queue(TEST_PATH, 10);
+	queue.waitStrategy(fq_wait_adaptive);
+
+	// The budget halves when the spin runs out before an item arrives.
+	int budget = queue.spinBudget();
+	assert(budget == FQ_SPIN_LIMIT / 8);
+	boost::thread late(boost::bind(&pushAfter, &queue, 50, 1));
+	assert(queue.popw() == 1);
+	late.join();
+	assert(queue.spinBudget() == budget / 2);
+
+	// It doubles when an item arrives while spinning. The producer may also push before the
+	// consumer starts spinning, which leaves the budget alone, so try a few times.
+	bool doubled = false;
+	for (int i = 0; i < 100 && !doubled; i++) {
+		budget = queue.spinBudget();
+		boost::thread soon(boost::bind(&pushAfter, &queue, 0, 2));
+		assert(queue.popw() == 2);
+		soon.join();
+		doubled = queue.spinBudget() == budget * 2;
+	}
+	assert(doubled);
+}
+
+int main() {
+	reset();
+	assert(fq_spin_useful());
+	run(fq_wait_block);
+	run(fq_wait_spin);
+	run(fq_wait_adaptive);
+	adapt();
+	reset();
+	return 0;
+}
@@ -0,0 +1,148 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void consume(IntQueue *queue, int count, vector<int> *popped) {
+	for (int i = 0; i < count; i++) {
+		if (i % 7 == 0) {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+		popped->push_back(queue->popw());
+	}
+}
+
+void produce(IntQueue *queue, int item) {
+	queue->push(item);
+}
+
+int main() {
+	reset();
+
+	{
+		// Rejecting producers get false above the soft limit and nothing is spilled.
+		IntQueue queue(TEST_PATH, 10);
+		queue.overflowPolicy(fq_overflow_reject, 5);
+		for (int i = 0; i < 5; i++) {
+			assert(queue.push(i));
+		}
+		assert(!queue.push(5));
+		assert(!queue.emplace(5));
+		assert(queue.size() == 5);
+		assert(queue.popw() == 0);
+		assert(queue.push(5));
+		assert(!queue.push(6));
+		assert(queue.failOverFiles().empty());
+	}
+
+	{
+		// Without a soft limit, or with one above the hard limit, producers are held back at the hard limit.
+		IntQueue queue(TEST_PATH, 10);
+		queue.overflowPolicy(fq_overflow_reject);
+		for (int i = 0; i < 10; i++) {
+			assert(queue.push(i));
+		}
+		assert(!queue.push(10));
+		queue.overflowPolicy(fq_overflow_reject, 50);
+		assert(!queue.push(10));
+		assert(queue.size() == 10);
+		assert(queue.failOverFiles().empty());
+	}
+
+	{
+		// Blocking producers accept items after the timeout and spill beyond the hard limit.
+		IntQueue queue(TEST_PATH, 10);
+		queue.overflowPolicy(fq_overflow_block, 5, 5);
+		boost::system_time start = boost::get_system_time();
+		for (int i = 0; i < 15; i++) {
+			assert(queue.push(i));
+		}
+		assert((boost::get_system_time() - start).total_milliseconds() >= 40);
+		assert(queue.failOverFiles().size() > 0);
+		for (int i = 0; i < 15; i++) {
+			queue.popw();
+		}
+	}
+
+	reset();
+
+	{
+		// With a consumer keeping up, blocking producers never spill and order is kept.
+		IntQueue queue(TEST_PATH, 10);
+		queue.overflowPolicy(fq_overflow_block, 5, 10000);
+		vector<int> popped;
+		boost::thread consumer(boost::bind(&consume, &queue, 200, &popped));
+		for (int i = 0; i < 200; i++) {
+			assert(queue.push(i));
+			assert(queue.size() <= 5);
+		}
+		consumer.join();
+		assert(queue.failOverFiles().empty());
+		for (int i = 0; i < 200; i++) {
+			assert(popped[i] == i);
+		}
+
+		// clear() releases a blocked producer.
+		for (int i = 0; i < 5; i++) {
+			queue.push(i);
+		}
+		boost::thread producer(boost::bind(&produce, &queue, 5));
+		boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+		queue.clear(true);
+		producer.join();
+	}
+
+	reset();
+	return 0;
+}
@@ -0,0 +1,150 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void produce(IntQueue *queue, int base, int count) {
+	IntQueue::Producer producer = queue->producer(16);
+	for (int i = 0; i < count; i++) {
+		producer.push(base + i);
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// Items stay buffered until the batch is full, the deadline passes, flush() or destruction.
+		IntQueue queue(TEST_PATH, 1000);
+		{
+			IntQueue::Producer producer = queue.producer(4, 1000000);
+			for (int i = 0; i < 3; i++) {
+				assert(producer.push(i));
+			}
+			assert(queue.size() == 0 && producer.size() == 3);
+			assert(producer.emplace(3));
+			assert(queue.size() == 4 && producer.size() == 0);
+			producer.push(4);
+			assert(producer.flush());
+			assert(queue.size() == 5);
+			producer.push(5);
+		}
+		assert(queue.size() == 6);
+
+		IntQueue::Producer producer = queue.producer(100, 0);
+		producer.push(6);
+		assert(queue.size() == 7);
+		for (int i = 0; i < 7; i++) {
+			assert(queue.popw() == i);
+		}
+	}
+
+	{
+		// Items rejected by the overflow policy stay buffered in order.
+		IntQueue queue(TEST_PATH, 1000);
+		queue.overflowPolicy(fq_overflow_reject, 3);
+		IntQueue::Producer producer = queue.producer(5);
+		for (int i = 0; i < 4; i++) {
+			assert(producer.push(i));
+		}
+		assert(!producer.push(4));
+		assert(queue.size() == 3 && producer.size() == 2);
+		assert(queue.popw() == 0 && queue.popw() == 1);
+		assert(producer.flush());
+		for (int i = 2; i < 5; i++) {
+			assert(queue.popw() == i);
+		}
+	}
+
+	{
+		// Each producer keeps its order while its batches interleave with the others.
+		IntQueue queue(TEST_PATH, 100000);
+		boost::thread_group producers;
+		for (int p = 0; p < 4; p++) {
+			producers.create_thread(boost::bind(&produce, &queue, p * 1000, 500));
+		}
+		vector<int> next(4, 0);
+		for (int i = 0; i < 2000; i++) {
+			int item = queue.popw();
+			int p = item / 1000;
+			assert(item % 1000 == next[p]);
+			next[p]++;
+		}
+		producers.join_all();
+		assert(queue.size() == 0);
+	}
+
+	{
+		// Batches that overflow the queue are spilled and every item is read back once.
+		IntQueue queue(TEST_PATH, 100);
+		boost::thread_group producers;
+		for (int p = 0; p < 4; p++) {
+			producers.create_thread(boost::bind(&produce, &queue, p * 1000, 500));
+		}
+		producers.join_all();
+		assert(queue.failOverFiles().size() > 0);
+		vector<int> seen(4000, 0);
+		for (int i = 0; i < 2000; i++) {
+			seen[queue.popw()]++;
+		}
+		for (int p = 0; p < 4; p++) {
+			for (int i = 0; i < 500; i++) {
+				assert(seen[p * 1000 + i] == 1);
+			}
+		}
+	}
+
+	reset();
+	return 0;
+}
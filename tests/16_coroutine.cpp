@@ -0,0 +1,174 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+#if FQ_COROUTINES
+
+//! A coroutine that starts at once and frees itself when it finishes.
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return Task(); }
+		std::suspend_never initial_suspend() { return std::suspend_never(); }
+		std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+		void return_void() { }
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+Task popInto(IntQueue *queue, int count, vector<int> *popped) {
+	for (int i = 0; i < count; i++) {
+		popped->push_back(co_await queue->async_pop());
+	}
+}
+
+Task pushFrom(IntQueue *queue, int item, vector<bool> *results) {
+	results->push_back(co_await queue->async_push(item));
+}
+
+void produce(IntQueue *queue, int count) {
+	for (int i = 0; i < count; i++) {
+		queue->push(i);
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// A pop completes at once when an item is queued, and otherwise resumes on the next push.
+		IntQueue queue(TEST_PATH, 1000);
+		queue.push(7);
+		vector<int> popped;
+		popInto(&queue, 2, &popped);
+		assert(popped.size() == 1 && popped[0] == 7);
+		queue.push(8);
+		assert(popped.size() == 2 && popped[1] == 8);
+		assert(queue.size() == 0);
+	}
+
+	{
+		// The resume hook decides where waiting coroutines run.
+		IntQueue queue(TEST_PATH, 1000);
+		vector<std::coroutine_handle<> > scheduled;
+		queue.resumeHook([&scheduled](std::coroutine_handle<> handle) { scheduled.push_back(handle); });
+		vector<int> popped;
+		popInto(&queue, 1, &popped);
+		queue.push(1);
+		assert(popped.empty() && scheduled.size() == 1);
+		scheduled[0].resume();
+		assert(popped.size() == 1 && popped[0] == 1);
+	}
+
+	{
+		// Pushes complete after their spill, and wait for room under the blocking policy.
+		IntQueue queue(TEST_PATH, 10);
+		vector<bool> results;
+		for (int i = 0; i < 12; i++) {
+			pushFrom(&queue, i, &results);
+		}
+		assert(results.size() == 12 && queue.failOverFiles().size() == 1);
+		queue.clear(true);
+	}
+	reset();
+
+	{
+		IntQueue queue(TEST_PATH, 1000);
+		queue.overflowPolicy(fq_overflow_block, 2);
+		vector<bool> results;
+		for (int i = 0; i < 3; i++) {
+			pushFrom(&queue, i, &results);
+		}
+		assert(results.size() == 2 && queue.size() == 2);
+		assert(queue.popw() == 0);
+		assert(results.size() == 3 && results[2] && queue.size() == 2);
+
+		queue.overflowPolicy(fq_overflow_reject, 2);
+		pushFrom(&queue, 3, &results);
+		assert(results.size() == 4 && !results[3]);
+	}
+
+	{
+		// clear() resumes waiting pops with a default item.
+		IntQueue queue(TEST_PATH, 1000);
+		vector<int> popped;
+		popInto(&queue, 1, &popped);
+		queue.clear(true);
+		assert(popped.size() == 1 && popped[0] == 0);
+	}
+
+	{
+		// A coroutine is resumed on the producer thread for every item, in order.
+		IntQueue queue(TEST_PATH, 100);
+		vector<int> popped;
+		popInto(&queue, 1000, &popped);
+		boost::thread producer(boost::bind(&produce, &queue, 1000));
+		producer.join();
+		assert(popped.size() == 1000);
+		for (int i = 0; i < 1000; i++) {
+			assert(popped[i] == i);
+		}
+	}
+
+	reset();
+	return 0;
+}
+
+#else
+
+int main() {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,209 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if FQ_EVENTFD
+#include <poll.h>
+#include <sys/epoll.h>
+#endif
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+#if FQ_EVENTFD
+
+bool readable(int fd) {
+	struct pollfd entry;
+	entry.fd = fd;
+	entry.events = POLLIN;
+	entry.revents = 0;
+	return poll(&entry, 1, 0) == 1 && (entry.revents & POLLIN);
+}
+
+void produce(IntQueue *queue, int base, int count) {
+	for (int i = 0; i < count; i++) {
+		queue->push(base + i);
+		if (i % 50 == 0) {
+			boost::this_thread::yield();
+		}
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// The descriptor is readable while items are in memory and cleared by the pop that empties the queue.
+		IntQueue queue(TEST_PATH, 10);
+		int fd = queue.readyFd();
+		assert(fd >= 0 && queue.readyFd() == fd);
+		assert(!readable(fd));
+		queue.push(1);
+		assert(readable(fd));
+		queue.push(2);
+		assert(queue.popw() == 1);
+		assert(readable(fd));
+		int item;
+		assert(queue.try_pop(item) && item == 2);
+		assert(!readable(fd));
+
+		// Batches stop when the queue and its failover files are empty.
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		assert(queue.failOverFiles().size() > 0);
+		vector<int> items;
+		assert(queue.try_pop(items, 20) == 20);
+		assert(readable(fd));
+		assert(queue.try_pop(items, 20) == 5);
+		assert(items.size() == 25);
+		assert(!readable(fd));
+		assert(queue.try_pop(items, 20) == 0);
+
+		for (int i = 0; i < 15; i++) {
+			queue.push(i);
+		}
+	}
+
+	{
+		// Failover files left by an earlier queue make a new queue readable.
+		IntQueue queue(TEST_PATH, 10);
+		assert(queue.size() == 0 && queue.failOverFiles().size() > 0);
+		int fd = queue.readyFd();
+		assert(readable(fd));
+		vector<int> items;
+		while (queue.try_pop(items, 4) > 0);
+		assert(!readable(fd));
+	}
+
+	size_t files = 0;
+	{
+		// Failover files removed behind the queue's back stop it being readable once they are skipped.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		files = queue.failOverFiles().size();
+		assert(files > 1);
+	}
+
+	{
+		IntQueue queue(TEST_PATH, 10);
+		assert(queue.size() == 0 && queue.failOverFiles().size() == files);
+		reset();
+		int fd = queue.readyFd();
+		assert(readable(fd));
+		int item;
+		assert(!queue.try_pop(item));
+		vector<int> items;
+		assert(queue.try_pop(items, 10) == 0);
+		assert(queue.stats().missingFiles == files);
+		assert(!readable(fd));
+	}
+
+	{
+		// One loop thread drains several queues fed by their own producers through epoll.
+		const int queues = 4;
+		const int count = 2000;
+		vector<IntQueue *> queue;
+		int epoll = epoll_create1(0);
+		assert(epoll >= 0);
+		for (int q = 0; q < queues; q++) {
+			stringstream prefix;
+			prefix << "failover-e" << q << "-";
+			queue.push_back(new IntQueue(TEST_PATH, prefix.str(), 100));
+			struct epoll_event event;
+			event.events = EPOLLIN;
+			event.data.u32 = q;
+			assert(epoll_ctl(epoll, EPOLL_CTL_ADD, queue[q]->readyFd(), &event) == 0);
+		}
+		boost::thread_group producers;
+		for (int q = 0; q < queues; q++) {
+			producers.create_thread(boost::bind(&produce, queue[q], q * count, count));
+		}
+		vector<int> seen(queues * count, 0);
+		int received = 0;
+		while (received < queues * count) {
+			struct epoll_event events[queues];
+			int ready = epoll_wait(epoll, events, queues, 1000);
+			assert(ready > 0);
+			for (int e = 0; e < ready; e++) {
+				vector<int> items;
+				queue[events[e].data.u32]->try_pop(items, 64);
+				for (size_t i = 0; i < items.size(); i++) {
+					seen[items[i]]++;
+				}
+				received += (int) items.size();
+			}
+		}
+		producers.join_all();
+		for (int i = 0; i < queues * count; i++) {
+			assert(seen[i] == 1);
+		}
+		for (int q = 0; q < queues; q++) {
+			assert(!readable(queue[q]->readyFd()));
+			delete queue[q];
+		}
+		close(epoll);
+	}
+
+	reset();
+	return 0;
+}
+
+#else
+
+int main() {
+	return 0;
+}
+
+#endif
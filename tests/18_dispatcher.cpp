@@ -0,0 +1,126 @@
+
+#include "FailoverDispatcher.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverDispatcher<int, int> IntDispatcher;
+typedef IntDispatcher::queue_type IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+boost::mutex seenMutex;
+vector<int> seen(5000, 0);
+int handled = 0;
+
+void handle(vector<int> &items) {
+	boost::this_thread::sleep(boost::posix_time::microseconds(500));
+	boost::mutex::scoped_lock lock(seenMutex);
+	for (size_t i = 0; i < items.size(); i++) {
+		seen[items[i]]++;
+	}
+	handled += (int) items.size();
+}
+
+int handledCount() {
+	boost::mutex::scoped_lock lock(seenMutex);
+	return handled;
+}
+
+int main() {
+	reset();
+
+	IntQueue queue(TEST_PATH, 200);
+	{
+		// Workers are added while the backlog, including spilled items, outgrows them.
+		IntDispatcher dispatcher(queue, &handle, 1, 16);
+		dispatcher.scale(1, 4, 10);
+		dispatcher.pin(true);
+		dispatcher.start();
+		assert(dispatcher.workers() == 1);
+
+		for (int i = 0; i < 5000; i++) {
+			queue.push(i);
+		}
+		assert(queue.failOverFiles().size() > 0);
+		assert(queue.backlog() > 200);
+
+		int peak = 1;
+		for (int i = 0; i < 6000 && handledCount() < 5000; i++) {
+			peak = max(peak, dispatcher.workers());
+			boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+		}
+		assert(handledCount() == 5000);
+		assert(peak > 1);
+		assert(queue.backlog() == 0);
+
+		// Workers are parked again once the queue is idle.
+		for (int i = 0; i < 1000 && dispatcher.workers() > 1; i++) {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+		}
+		assert(dispatcher.workers() == 1);
+
+		fq_dispatch_stats stats = dispatcher.stats();
+		assert(stats.items == 5000);
+		assert(stats.batches >= 5000 / 16);
+		assert(stats.maxHandlerNanos >= 500000);
+		assert(stats.handlerNanos >= stats.batches * 500000);
+		dispatcher.stop();
+	}
+
+	for (int i = 0; i < 5000; i++) {
+		assert(seen[i] == 1);
+	}
+
+	// A stopped dispatcher leaves items in the queue.
+	queue.push(1);
+	assert(queue.size() == 1);
+
+	reset();
+	return 0;
+}
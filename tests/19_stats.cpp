@@ -0,0 +1,126 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// Spills and reloads are counted with their items and bytes.
+		IntQueue queue(TEST_PATH, 10);
+		fq_stats stats = queue.stats();
+		assert(stats.pushed == 0 && stats.spills == 0);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		stats = queue.stats();
+		assert(stats.pushed == 25);
+		assert(stats.spills == queue.failOverFiles().size() && stats.spills > 0);
+		assert(stats.itemsSpilled == 25 - (unsigned long) queue.size());
+		assert(stats.bytesSpilled == queue.diskBytes());
+
+		while (queue.size() > 0) {
+			queue.popw();
+		}
+		stats = queue.stats();
+		assert(stats.popped == 25);
+		assert(stats.reloads == stats.spills);
+		assert(stats.itemsReloaded == stats.itemsSpilled);
+		assert(stats.bytesReloaded == stats.bytesSpilled);
+		assert(stats.missingFiles == 0 && stats.corruptFiles == 0);
+		assert(queue.latency(fq_latency_push).count() == 0);
+
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+	}
+
+	{
+		// A failover file that disappeared is counted and skipped.
+		IntQueue queue(TEST_PATH, 10);
+		vector<string> files = queue.failOverFiles();
+		assert(files.size() > 1);
+		boost::filesystem::remove(files[0]);
+		vector<int> items;
+		while (queue.try_pop(items, 100) > 0);
+		assert(items.size() == (files.size() - 1) * 5);
+		assert(queue.stats().missingFiles == 1);
+		assert(queue.stats().reloads == files.size() - 1);
+	}
+
+	{
+		// A damaged failover file is counted, removed and skipped.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+	}
+	{
+		IntQueue queue(TEST_PATH, 10);
+		vector<string> files = queue.failOverFiles();
+		assert(files.size() > 1);
+		{
+			ofstream ofs(files[1].c_str());
+			ofs << "22 serialization::archive 18 0 0 5 0 1 2";
+		}
+		vector<int> items;
+		while (queue.try_pop(items, 100) > 0);
+		assert(items.size() == (files.size() - 1) * 5);
+		fq_stats stats = queue.stats();
+		assert(stats.corruptFiles == 1 && stats.reloads == files.size() - 1 && stats.itemsReloaded == items.size());
+		assert(!boost::filesystem::exists(files[1]));
+	}
+
+	reset();
+	return 0;
+}
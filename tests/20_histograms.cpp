@@ -0,0 +1,127 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+bool near(unsigned long long value, unsigned long long expected) {
+	return value >= expected * 7 / 8 && value <= expected * 9 / 8;
+}
+
+void record(fq_histogram *histogram, int count) {
+	for (int i = 1; i <= count; i++) {
+		histogram->record(i);
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// Every value lands in a bucket no more than 12.5% wide.
+		for (unsigned long long value = 0; value < 100000; value += 7) {
+			int index = fq_histogram_buckets::index(value);
+			assert(value <= fq_histogram_buckets::upper(index));
+			assert(index == 0 || value > fq_histogram_buckets::upper(index - 1));
+			assert(fq_histogram_buckets::upper(index) - value <= value / 8);
+		}
+		assert(fq_histogram_buckets::index(1ULL << 50) == fq_histogram_buckets::count - 1);
+	}
+
+	{
+		// Stripes recorded by several threads merge into one distribution.
+		fq_histogram histogram;
+		boost::thread_group threads;
+		for (int t = 0; t < 4; t++) {
+			threads.create_thread(boost::bind(&record, &histogram, 10000));
+		}
+		threads.join_all();
+		fq_histogram_snapshot snapshot = histogram.snapshot();
+		assert(snapshot.count() == 40000);
+		assert(snapshot.max() == 10000);
+		assert(snapshot.mean() > 5000 && snapshot.mean() < 5001);
+		assert(near(snapshot.percentile(50), 5000));
+		assert(near(snapshot.percentile(99), 9900));
+		assert(snapshot.percentile(100) == 10000);
+
+		fq_histogram_snapshot merged;
+		merged.merge(snapshot);
+		merged.merge(histogram.snapshot(true));
+		assert(merged.count() == 80000);
+		assert(histogram.snapshot().count() == 0);
+	}
+
+	{
+		// The queue records pushes, pops, spills, reloads and time in memory.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		for (int i = 0; i < 25; i++) {
+			queue.popw();
+		}
+		fq_stats stats = queue.stats();
+		assert(queue.latency(fq_latency_push).count() == 25);
+		assert(queue.latency(fq_latency_popw).count() == 25);
+		assert(queue.latency(fq_latency_spill).count() == stats.spills);
+		assert(queue.latency(fq_latency_reload).count() == stats.reloads);
+		assert(queue.latency(fq_latency_in_queue).count() == 25);
+		assert(queue.latency(fq_latency_spill).max() > 0);
+
+		assert(queue.latency(fq_latency_push, true).count() == 25);
+		assert(queue.latency(fq_latency_push).count() == 0);
+	}
+
+	reset();
+	return 0;
+}
@@ -0,0 +1,123 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+vector<pair<fq_log_level, string> > logged;
+
+void capture(fq_log_level level, const char * /* file */, int /* line */, const std::string &message) {
+	logged.push_back(make_pair(level, message));
+}
+
+int count(fq_log_level level, const string &prefix) {
+	int found = 0;
+	for (size_t i = 0; i < logged.size(); i++) {
+		if (logged[i].first == level && logged[i].second.find(prefix) == 0) {
+			found++;
+		}
+	}
+	return found;
+}
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// Nothing is sent until a logger is installed.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		assert(logged.empty());
+	}
+
+	fq_set_logger(&capture);
+
+	{
+		// Failover files read back and skipped are logged with their level.
+		IntQueue queue(TEST_PATH, 10);
+		vector<string> files = queue.failOverFiles();
+		assert(files.size() > 1);
+		boost::filesystem::remove(files[0]);
+		vector<int> items;
+		while (queue.try_pop(items, 100) > 0);
+		assert(count(fq_log_info, "Loading: ") == (int) files.size());
+		assert(count(fq_log_warn, "Skipping missing file: ") == 1);
+	}
+
+	{
+		// Spills are logged, and levels above FQ_LOG_LEVEL are compiled out.
+		logged.clear();
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		assert(count(fq_log_info, "Saving: ") == (int) queue.stats().spills);
+		FQ_LOG(fq_log_debug, "Dropped");
+		FQ_LOG(fq_log_info, "Kept " << 1);
+		assert(count(fq_log_debug, "Dropped") == 0);
+		assert(count(fq_log_info, "Kept 1") == 1);
+
+		// FQ_LOG() is a single statement, so an else binds to the caller's if.
+		bool branch = false;
+		if (queue.size() < 0)
+			FQ_LOG(fq_log_info, "Never");
+		else
+			branch = true;
+		assert(branch);
+		assert(count(fq_log_info, "Never") == 0);
+	}
+
+	fq_set_logger(0);
+	reset();
+	return 0;
+}
@@ -0,0 +1,106 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void consume(IntQueue *queue, int *item) {
+	*item = queue->popw();
+}
+
+int main() {
+	reset();
+
+	{
+		// Every acquisition records a wait, and spilling or reloading holds are charged to their own site.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		fq_stats stats = queue.stats();
+		assert(stats.spills > 0);
+		assert(queue.lockWait(fq_lock_push).count() == 25);
+		assert(queue.lockHold(fq_lock_spill).count() == stats.spills);
+		assert(queue.lockHold(fq_lock_push).count() == 25 - stats.spills);
+
+		for (int i = 0; i < 25; i++) {
+			queue.popw();
+		}
+		stats = queue.stats();
+		assert(stats.reloads > 0);
+		assert(queue.lockWait(fq_lock_pop).count() == 25);
+		assert(queue.lockHold(fq_lock_reload).count() == stats.reloads);
+		assert(queue.lockHold(fq_lock_pop).count() == 25 - stats.reloads);
+
+		assert(queue.empty() && queue.size() == 0);
+		assert(queue.lockWait(fq_lock_observer).count() == 2);
+		assert(queue.lockHold(fq_lock_observer, true).count() == 2);
+		assert(queue.lockHold(fq_lock_observer).count() == 0);
+	}
+
+	{
+		// Time a consumer spends blocked in popw() is not counted as holding the lock.
+		IntQueue queue(TEST_PATH, 10);
+		int item = -1;
+		boost::thread consumer(boost::bind(&consume, &queue, &item));
+		boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+		queue.push(7);
+		consumer.join();
+		assert(item == 7);
+		assert(queue.lockHold(fq_lock_pop).count() == 2);
+		assert(queue.lockHold(fq_lock_pop).max() < 100000000ULL);
+	}
+
+	reset();
+	return 0;
+}
@@ -0,0 +1,136 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+const unsigned long long MILLIS = 1000000ULL;
+
+// The layout of failover files written before push times were stored.
+struct Legacy {
+	std::vector<int> data;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & data;
+	}
+};
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+void pause(int millis) {
+	boost::this_thread::sleep(boost::posix_time::milliseconds(millis));
+}
+
+int main() {
+	reset();
+
+	{
+		// An empty queue has no ages.
+		IntQueue queue(TEST_PATH, 10);
+		fq_ages ages = queue.ages();
+		assert(ages.memory == 0 && ages.disk == 0);
+	}
+
+	{
+		// Spilled items keep their push times, so the disk tier is older than memory.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 12; i++) {
+			queue.push(i);
+		}
+		pause(200);
+		for (int i = 12; i < 25; i++) {
+			queue.push(i);
+		}
+		assert(queue.failOverFiles().size() > 0);
+		fq_ages ages = queue.ages();
+		assert(ages.disk >= 150 * MILLIS);
+		assert(ages.memory < ages.disk);
+	}
+
+	{
+		// Push times survive a restart, and reloaded items count their time on disk.
+		IntQueue queue(TEST_PATH, 10);
+		assert(queue.ages().disk >= 150 * MILLIS);
+		int popped = 0;
+		while (queue.backlog() > 0 && popped < 100) {
+			queue.popw();
+			popped++;
+		}
+		assert(queue.stats().queuedNanos >= queue.stats().itemsReloaded * 150 * MILLIS);
+		fq_ages ages = queue.ages();
+		assert(ages.memory == 0 && ages.disk == 0);
+	}
+
+	{
+		// Files written without push times load, with the file time standing in for their items.
+		{
+			Legacy legacy;
+			for (int i = 0; i < 5; i++) {
+				legacy.data.push_back(i);
+			}
+			std::ofstream ofs(TEST_PATH "failover1" FQ_EXT);
+			boost::archive::text_oarchive oa(ofs);
+			const Legacy &saved = legacy;
+			oa << saved;
+		}
+		pause(100);
+		IntQueue queue(TEST_PATH, 10);
+		assert(queue.ages().disk >= 50 * MILLIS);
+		for (int i = 0; i < 5; i++) {
+			assert(queue.popw() == i);
+		}
+		assert(queue.stats().itemsReloaded == 5 && queue.stats().corruptFiles == 0);
+		assert(queue.stats().queuedNanos > 0);
+	}
+
+	reset();
+	return 0;
+}
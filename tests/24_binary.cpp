@@ -0,0 +1,128 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+class Record {
+public:
+	Record() : id_(0) { }
+	explicit Record(int id) : id_(id), name_("record") { }
+	int id() const { return id_; }
+	const std::string &name() const { return name_; }
+private:
+	friend class boost::serialization::access;
+
+	int id_;
+	std::string name_;
+
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int /* version */) {
+		ar & id_;
+		ar & name_;
+	}
+};
+
+typedef boost::shared_ptr<Record> RecordPtr;
+typedef FailoverQueue<int, int> IntQueue;
+typedef FailoverQueue<Record, RecordPtr> RecordQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+int main() {
+	reset();
+
+	{
+		// Primitive items written as binary arrays read back after a restart.
+		unsigned long spilled = 0;
+		{
+			IntQueue queue(TEST_PATH, 10);
+			for (int i = 0; i < 100; i++) {
+				queue.push(i);
+			}
+			assert(queue.failOverFiles().size() > 1);
+			spilled = queue.stats().itemsSpilled;
+		}
+		// Give the files an age the coarse clock can tell apart from their modification time.
+		boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+		IntQueue queue(TEST_PATH, 10);
+		assert(queue.ages().disk > 0);
+		vector<int> items;
+		while (queue.try_pop(items, 100) > 0);
+		assert(queue.stats().corruptFiles == 0);
+		assert(items.size() == spilled);
+		sort(items.begin(), items.end());
+		for (size_t i = 0; i < items.size(); i++) {
+			assert(items[i] == (int) i);
+		}
+	}
+
+	reset();
+
+	{
+		// Class items round trip through binary failover files.
+		RecordQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 50; i++) {
+			queue.push(RecordPtr(new Record(i)));
+		}
+		vector<int> ids;
+		for (int i = 0; i < 50; i++) {
+			RecordPtr record = queue.popw();
+			assert(record->name() == "record");
+			ids.push_back(record->id());
+		}
+		assert(queue.stats().reloads > 0 && queue.stats().corruptFiles == 0);
+		sort(ids.begin(), ids.end());
+		for (int i = 0; i < 50; i++) {
+			assert(ids[i] == i);
+		}
+	}
+
+	reset();
+	return 0;
+}
@@ -0,0 +1,122 @@
+
+#include "FailoverQueue.hpp"
+
+/*
+** Copyright (c) 2010-2011 Blizzard Entertainment
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+** 
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+*/
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define TEST_PATH "./"
+
+using namespace std;
+
+typedef FailoverQueue<int, int> IntQueue;
+
+void reset() {
+	if (!boost::filesystem::is_directory(TEST_PATH)) {
+		return;
+	}
+	boost::filesystem::directory_iterator end_iter;
+	for (boost::filesystem::directory_iterator dir_itr(TEST_PATH); dir_itr != end_iter; ++dir_itr) {
+		if (boost::filesystem::is_regular_file(dir_itr->status())) {
+			std::string fileName = dir_itr->path().filename().string();
+			if (fileName.find("failover") == 0) {
+				boost::filesystem::remove(dir_itr->path().filename());
+			}
+		}
+	}
+}
+
+int count(const string &text, const string &needle) {
+	int found = 0;
+	for (size_t at = text.find(needle); at != string::npos; at = text.find(needle, at + 1)) {
+		found++;
+	}
+	return found;
+}
+
+string dump() {
+	stringstream out;
+	fq_trace_dump(out);
+	return out.str();
+}
+
+void consume(IntQueue *queue, int *item) {
+	*item = queue->popw();
+}
+
+int main() {
+	reset();
+
+	{
+		// Spills and reloads are recorded as begin and end pairs.
+		IntQueue queue(TEST_PATH, 10);
+		for (int i = 0; i < 25; i++) {
+			queue.push(i);
+		}
+		for (int i = 0; i < 25; i++) {
+			queue.popw();
+		}
+		fq_stats stats = queue.stats();
+		string trace = dump();
+		assert(trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+		assert(trace.find("]}") != string::npos);
+		assert(count(trace, "\"name\":\"spill\",\"cat\":\"failoverqueue\",\"ph\":\"B\"") == (int) stats.spills);
+		assert(count(trace, "\"name\":\"spill\",\"cat\":\"failoverqueue\",\"ph\":\"E\"") == (int) stats.spills);
+		assert(count(trace, "\"name\":\"reload\",\"cat\":\"failoverqueue\",\"ph\":\"B\"") == (int) stats.reloads);
+		assert(count(trace, "\"name\":\"reload\",\"cat\":\"failoverqueue\",\"ph\":\"E\"") == (int) stats.reloads);
+	}
+
+	{
+		// A consumer blocked in popw() shows up as a span on its own thread.
+		IntQueue queue(TEST_PATH, 10);
+		int item = -1;
+		boost::thread consumer(boost::bind(&consume, &queue, &item));
+		boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+		queue.push(7);
+		consumer.join();
+		assert(item == 7);
+		string trace = dump();
+		assert(count(trace, "\"name\":\"consumer blocked\",\"cat\":\"failoverqueue\",\"ph\":\"B\"") >= 1);
+		assert(count(trace, "\"name\":\"consumer blocked\",\"cat\":\"failoverqueue\",\"ph\":\"E\"") >= 1);
+	}
+
+	{
+		// The ring keeps only the latest FQ_TRACE_EVENTS events.
+		IntQueue queue(TEST_PATH, 2);
+		for (int i = 0; i < 1000; i++) {
+			queue.push(i);
+		}
+		string trace = dump();
+		assert(count(trace, "\"cat\":\"failoverqueue\"") == FQ_TRACE_EVENTS);
+	}
+
+	reset();
+	return 0;
+}